@@ -0,0 +1,89 @@
+#include "cpu_info.h"
+
+#if _SIMD_X86_
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace sr
+{
+
+namespace
+{
+
+struct CPUFeatures
+{
+	bool sse41 = false;
+	bool avx2 = false;
+
+	CPUFeatures()
+	{
+#if _SIMD_X86_
+		int info[4] = { 0, 0, 0, 0 };
+		CPUID(info, 0, 0);
+		int maxLeaf = info[0];
+		if (maxLeaf < 1) return;
+
+		CPUID(info, 1, 0);
+		sse41 = (info[2] & (1 << 19)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		// the OS has to save the ymm registers too, or AVX faults
+		if (!osxsave || !avx || (XGetBV() & 0x6) != 0x6) return;
+
+		if (maxLeaf < 7) return;
+		CPUID(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+#endif
+	}
+
+#if _SIMD_X86_
+	static void CPUID(int info[4], int leaf, int subleaf)
+	{
+#if defined(_MSC_VER)
+		__cpuidex(info, leaf, subleaf);
+#else
+		unsigned int a, b, c, d;
+		__cpuid_count(leaf, subleaf, a, b, c, d);
+		info[0] = (int)a;
+		info[1] = (int)b;
+		info[2] = (int)c;
+		info[3] = (int)d;
+#endif
+	}
+
+	static uint64_t XGetBV()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((uint64_t)edx << 32) | eax;
+#endif
+	}
+#endif
+};
+
+const CPUFeatures& GetCPUFeatures()
+{
+	static CPUFeatures features;
+	return features;
+}
+
+}
+
+bool CPUInfo::HasSSE41()
+{
+	return GetCPUFeatures().sse41;
+}
+
+bool CPUInfo::HasAVX2()
+{
+	return GetCPUFeatures().avx2;
+}
+
+}
@@ -0,0 +1,17 @@
+#ifndef _BASE_CPU_INFO_H_
+#define _BASE_CPU_INFO_H_
+
+#include "header.h"
+
+namespace sr
+{
+
+struct CPUInfo
+{
+	static bool HasSSE41();
+	static bool HasAVX2();
+};
+
+}
+
+#endif // !_BASE_CPU_INFO_H_
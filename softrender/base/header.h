@@ -49,6 +49,27 @@
 #endif
 #endif
 
+#ifndef SIMD_ALIGN
+#if defined(_MSC_VER)
+#define SIMD_ALIGN __declspec(align(16))
+#else
+#define SIMD_ALIGN alignas(16)
+#endif
+#endif
+
+// x86 kernels are built for every instruction set and selected at runtime (see CPUInfo)
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define _SIMD_X86_ 1
+#include "immintrin.h"
+#if defined(_MSC_VER)
+#define SIMD_TARGET_SSE41
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
 #define FLIP_RGB(bytes) std::swap(*(bytes + 2), *(bytes + 0));
 
 #include "glfw/include/GLFW/glfw3.h"
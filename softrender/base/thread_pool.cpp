@@ -0,0 +1,84 @@
+#include "thread_pool.h"
+
+namespace sr
+{
+
+ThreadPool::ThreadPool(int threadCount)
+	: nextIndex(0)
+{
+	for (int i = 1; i < threadCount; ++i)
+	{
+		threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isExiting = true;
+	}
+	wakeCondition.notify_all();
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void ThreadPool::ParallelFor(int count, const TaskFunc& func)
+{
+	if (count <= 0) return;
+	if (threads.empty() || count == 1)
+	{
+		for (int i = 0; i < count; ++i) func(i, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		task = &func;
+		taskCount = count;
+		nextIndex = 0;
+		busyCount = (int)threads.size();
+		++generation;
+	}
+	wakeCondition.notify_all();
+
+	RunTasks(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this] { return busyCount == 0; });
+	task = nullptr;
+}
+
+void ThreadPool::WorkerLoop(int threadIndex)
+{
+	uint64_t finishedGeneration = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [&] { return isExiting || generation != finishedGeneration; });
+			if (isExiting) return;
+			finishedGeneration = generation;
+		}
+
+		RunTasks(threadIndex);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyCount == 0) doneCondition.notify_all();
+	}
+}
+
+void ThreadPool::RunTasks(int threadIndex)
+{
+	for (;;)
+	{
+		int index = nextIndex.fetch_add(1);
+		if (index >= taskCount) return;
+		(*task)(index, threadIndex);
+	}
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef _BASE_THREAD_POOL_H_
+#define _BASE_THREAD_POOL_H_
+
+#include "header.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace sr
+{
+
+class ThreadPool;
+typedef std::shared_ptr<ThreadPool> ThreadPoolPtr;
+
+class ThreadPool
+{
+public:
+	typedef std::function<void(int index, int threadIndex)> TaskFunc;
+
+	explicit ThreadPool(int threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// worker threads plus the calling thread, which always runs as thread 0
+	int GetThreadCount() const { return (int)threads.size() + 1; }
+
+	// runs func(index, threadIndex) for index in [0, count) and blocks until all are done
+	void ParallelFor(int count, const TaskFunc& func);
+
+private:
+	void WorkerLoop(int threadIndex);
+	void RunTasks(int threadIndex);
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+
+	const TaskFunc* task = nullptr;
+	int taskCount = 0;
+	std::atomic<int> nextIndex;
+	int busyCount = 0;
+	uint64_t generation = 0;
+	bool isExiting = false;
+};
+
+}
+
+#endif // !_BASE_THREAD_POOL_H_
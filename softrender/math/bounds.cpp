@@ -0,0 +1,69 @@
+#include "bounds.h"
+#include "math/mathf.h"
+
+namespace sr
+{
+
+void Bounds::Calculate(const Vector3* points, int count)
+{
+	isValid = (count > 0);
+	if (!isValid)
+	{
+		min = max = center = Vector3::zero;
+		radius = 0.f;
+		return;
+	}
+
+	min = max = points[0];
+	for (int i = 1; i < count; ++i)
+	{
+		min = Vector3::Min(min, points[i]);
+		max = Vector3::Max(max, points[i]);
+	}
+
+	// centered on the box, looser than the minimal sphere but found in one more pass
+	center = (min + max) * 0.5f;
+	float sqrRadius = 0.f;
+	for (int i = 0; i < count; ++i)
+	{
+		sqrRadius = Mathf::Max(sqrRadius, (points[i] - center).SqrLength());
+	}
+	radius = Mathf::Sqrt(sqrRadius);
+}
+
+Bounds::FrustumTest Bounds::TestFrustum(const Matrix4x4& mvp) const
+{
+	if (!isValid) return FrustumTest_Intersect;
+
+	// rows of the column-major mvp
+	const float* m = mvp.m;
+	Vector4 row0(m[0], m[4], m[8], m[12]);
+	Vector4 row1(m[1], m[5], m[9], m[13]);
+	Vector4 row2(m[2], m[6], m[10], m[14]);
+	Vector4 row3(m[3], m[7], m[11], m[15]);
+
+	// near, far, left, right, bottom, top; a point is inside where plane.xyz . p + plane.w >= 0
+	Vector4 planes[6] = { row2, row3 - row2, row3 + row0, row3 - row0, row3 + row1, row3 - row1 };
+
+	bool isInside = true;
+	for (auto& plane : planes)
+	{
+		// sphere
+		float length = plane.xyz.Length();
+		if (length > 0.f)
+		{
+			float distance = (plane.xyz.Dot(center) + plane.w) / length;
+			if (distance < -radius) return FrustumTest_Outside;
+			if (distance >= radius) continue;
+		}
+
+		// box, the corner farthest along the plane normal and the one farthest against it
+		Vector3 positive(plane.x >= 0.f ? max.x : min.x, plane.y >= 0.f ? max.y : min.y, plane.z >= 0.f ? max.z : min.z);
+		Vector3 negative(plane.x >= 0.f ? min.x : max.x, plane.y >= 0.f ? min.y : max.y, plane.z >= 0.f ? min.z : max.z);
+		if (plane.xyz.Dot(positive) + plane.w < 0.f) return FrustumTest_Outside;
+		if (plane.xyz.Dot(negative) + plane.w < 0.f) isInside = false;
+	}
+	return isInside ? FrustumTest_Inside : FrustumTest_Intersect;
+}
+
+}
@@ -0,0 +1,39 @@
+#ifndef _MATH_BOUNDS_H_
+#define _MATH_BOUNDS_H_
+
+#include "base/header.h"
+#include "math/vector3.h"
+#include "math/vector4.h"
+#include "math/matrix4x4.h"
+
+namespace sr
+{
+
+// Axis-aligned box and bounding sphere of a point set, both in the points' own space.
+struct Bounds
+{
+	enum FrustumTest
+	{
+		FrustumTest_Outside,
+		FrustumTest_Intersect,
+		FrustumTest_Inside,
+	};
+
+	Vector3 min = Vector3::zero;
+	Vector3 max = Vector3::zero;
+	Vector3 center = Vector3::zero;
+	float radius = 0.f;
+	bool isValid = false;
+
+	Bounds() = default;
+
+	void Calculate(const Vector3* points, int count);
+
+	// Tests against the frustum of clip space 0 <= z <= w, -w <= x, y <= w, with the planes
+	// taken from mvp, so no bounds are transformed. Conservative: Intersect when unsure.
+	FrustumTest TestFrustum(const Matrix4x4& mvp) const;
+};
+
+}
+
+#endif //!_MATH_BOUNDS_H_
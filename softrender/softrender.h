@@ -24,46 +24,57 @@
 #include "softrender/shaderf.hpp"
 #include "softrender/pbsf.hpp"
 #include "softrender/rasterizer.hpp"
+#include "softrender/render_context.h"
+#include "softrender/command_list.h"
 
 namespace sr
 {
 
+// Static facade over a process-wide default RenderContext. Create more RenderContext
+// objects to render independent views concurrently.
 struct SoftRender
 {
-	static RenderState renderState;
-	static RenderData renderData;
+	static RenderState& renderState;
+	static RenderData& renderData;
 
-	static Matrix4x4 modelMatrix;
-	static CameraPtr camera;
-    static LightPtr light;
+	static Matrix4x4& modelMatrix;
+	static CameraPtr& camera;
+	static LightPtr& light;
+
+	static RenderContext& GetDefaultContext() { return defaultContext; }
 
 	static void Initialize(int width, int height);
-	static void SetRenderTarget(RenderTexturePtr target);
-	static RenderTexturePtr GetRenderTarget();
-	static void ClearStencilBuffer(uint8_t stencil);
-	static StencilBufferPtr GetStencilBuffer();
-	static void SetShader(ShaderPtr shader);
+	static void SetRenderTarget(RenderTexturePtr target) { defaultContext.SetRenderTarget(target); }
+	static RenderTexturePtr GetRenderTarget() { return defaultContext.GetRenderTarget(); }
+	static void ClearStencilBuffer(uint8_t stencil) { defaultContext.ClearStencilBuffer(stencil); }
+	static StencilBufferPtr GetStencilBuffer() { return defaultContext.GetStencilBuffer(); }
+	static void SetShader(ShaderPtr shader) { defaultContext.SetShader(shader); }
+	template<typename ShaderType>
+	static void SetShader(std::shared_ptr<ShaderType> shader) { defaultContext.SetShader(shader); }
+	static void SetThreadCount(int threadCount) { defaultContext.SetThreadCount(threadCount); }
+	static int GetThreadCount() { return defaultContext.GetThreadCount(); }
+	static void SetSubPixelBits(int bits) { defaultContext.SetSubPixelBits(bits); }
+	static void SetGuardBandClipping(bool enable) { defaultContext.SetGuardBandClipping(enable); }
+	static void SetVertexShadingMode(RenderContext::VertexShadingMode mode) { defaultContext.SetVertexShadingMode(mode); }
+	static const RenderContext::Stats& GetStats() { return defaultContext.GetStats(); }
+	static void ResetStats() { defaultContext.ResetStats(); }
 
-	static void Clear(bool clearColor, bool clearDepth, const Color& backgroundColor, float depth = 1.0f);
-	static void Submit(int startIndex = 0, int primitiveCount = 0);
+	static void Clear(bool clearColor, bool clearDepth, const Color& backgroundColor, float depth = 1.0f)
+	{
+		defaultContext.Clear(clearColor, clearDepth, backgroundColor, depth);
+	}
+	static void Submit(int startIndex = 0, int primitiveCount = 0) { defaultContext.Submit(startIndex, primitiveCount); }
+	static void SubmitInstanced(int instanceCount, const InstanceData* instances, int startIndex = 0, int primitiveCount = 0)
+	{
+		defaultContext.SubmitInstanced(instanceCount, instances, startIndex, primitiveCount);
+	}
+	static void Execute(const CommandList& commandList) { commandList.Execute(defaultContext); }
 	static void Present();
 
-private:
-	static bool InitShaderLightParams(ShaderPtr shader, const LightPtr& light);
-	static void RasterizerRenderFunc(const VertexVaryingData& data, const RasterizerInfo& info);
-	static void Rasterizer2x2RenderFunc(const Triangle<VertexVaryingData>& data,  const Rasterizer2x2Info& info);
-	static const Color& ShaderGBufferOutput(ShaderPtr& shader, int index);
-
-	static VaryingDataBuffer varyingDataBuffer;
-	static ShaderPtr shader;
+	static const int TILE_SIZE = RenderContext::TILE_SIZE;
 
-	static RenderTexturePtr defaultRenderTarget;
-	static RenderTexturePtr renderTarget;
-	static BitmapPtr colorBuffer;
-	static BitmapPtr depthBuffer;
-	static StencilBufferPtr stencilBuffer;
-
-	static Rasterizer rasterizer;
+private:
+	static RenderContext defaultContext;
 };
 
 }
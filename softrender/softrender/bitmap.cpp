@@ -150,6 +150,7 @@ void Bitmap::SetPixel(int x, int y, const Color& color)
 {
 	assert(x >= 0 && x < width);
 	assert(y >= 0 && y < height);
+	++generation;
 	switch (type)
 	{
 	case BitmapType_Alpha8:
@@ -200,6 +201,12 @@ float Bitmap::GetAlpha(int x, int y) const
 }
 
 void Bitmap::SetAlpha(int x, int y, float alpha)
+{
+	++generation;
+	WriteAlpha(x, y, alpha);
+}
+
+void Bitmap::WriteAlpha(int x, int y, float alpha)
 {
 	assert(x >= 0 && x < width);
 	assert(y >= 0 && y < height);
@@ -227,6 +234,7 @@ void Bitmap::SetAlpha(int x, int y, float alpha)
 void Bitmap::Fill(const Color& color)
 {
 	assert(bytes != nullptr);
+	++generation;
 
 	switch (type)
 	{
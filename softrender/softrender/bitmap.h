@@ -40,12 +40,20 @@ public:
 	void SetAlpha(int x, int y, float alpha);
 	void Fill(const Color& color);
 
-	rawptr_t GetBytes() { return bytes; }
+	// raw access counts as a write, the caller may change any pixel through it
+	rawptr_t GetBytes() { ++generation; return bytes; }
 	int GetWidth() const { return width; }
 	int GetHeight() const { return height; }
 	BitmapType GetType() const { return type; }
+	// bumped by SetPixel, SetAlpha, Fill and GetBytes
+	uint32_t GetGeneration() const { return generation; }
 
 protected:
+	friend class HiZBuffer;
+
+	// SetAlpha without the generation bump, for HiZBuffer::WriteDepth
+	void WriteAlpha(int x, int y, float alpha);
+
 	uint8_t GetPixel_Alpha8(int x, int y) const;
 	void SetPixel_Alpha8(int x, int y, uint8_t val);
 	Color32 GetPixel_RGB24(int x, int y) const;
@@ -65,6 +73,7 @@ protected:
 	int height = 0;
 
 	rawptr_t bytes = nullptr;
+	uint32_t generation = 0;
 };
 
 
@@ -115,13 +115,9 @@ rawptr_t Buffer::operator[](int idx)
 	if (idx < 0) return nullptr;
 	if (!isDynamicBuffer && idx >= allocatedBlockCount) return nullptr;
 
-	int page = 0;
-	int blockOffset = 0;
-	while (idx >= blockPrePage) {
-		idx -= blockPrePage;
-		++page;
-	}
-	blockOffset = idx;
+	// a division instead of walking the pages, large vertex counts span many pages
+	int page = idx / blockPrePage;
+	int blockOffset = idx - page * blockPrePage;
 	if (!AllocPage(page)) return nullptr;
 	return data[page] + blockOffset * blockSize;
 }
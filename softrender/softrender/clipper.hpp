@@ -2,6 +2,7 @@
 #define _SOFTRENDER_CLIPPER_HPP_
 
 #include "base/header.h"
+#include "math/vector2.h"
 #include "math/vector3.h"
 #include "math/vector4.h"
 #include "math/mathf.h"
@@ -11,12 +12,30 @@ namespace sr
 
 template <typename Type> struct Line;
 template <typename Type> struct Triangle;
+
+// Output of Clipper::ClipTriangle, a convex polygon drawn as a fan around vertices[0].
+// Every plane adds at most one vertex to the input triangle.
+template <typename Type>
+struct ClipPolygon
+{
+	static const int MAX_VERTEX_COUNT = 3 + 6;
+
+	Type vertices[MAX_VERTEX_COUNT];
+	int vertexCount = 0;
+
+	Triangle<Type> GetTriangle(int index) const
+	{
+		assert(index >= 0 && index + 2 < vertexCount);
+		return Triangle<Type>(vertices[0], vertices[index + 1], vertices[index + 2]);
+	}
+};
+
 struct Clipper
 {
 	struct Plane
 	{
-		typedef bool(*GetClipCodeFunc)(const Vector4& v);
-		typedef float(*ClippingFunc)(const Vector4& v0, const Vector4& v1);
+		typedef bool(*GetClipCodeFunc)(const Vector4& v, const Vector2& guardBand);
+		typedef float(*ClippingFunc)(const Vector4& v0, const Vector4& v1, const Vector2& guardBand);
 
 		uint32_t cullMask = 0x0;
 		GetClipCodeFunc getClipCodeFunc = nullptr;
@@ -27,13 +46,44 @@ struct Clipper
 			clippingFunc(_clippingFunc) {}
 	};
 
+	// near, far, then the four viewport planes
 	static Plane viewFrustumPlanes[6];
-	static uint32_t CalculateClipCode(const Vector4& hc)
+	// x/y planes at +-guardBand in ndc, the viewport planes only reject whole triangles
+	static Plane guardBandPlanes[4];
+
+	static const uint32_t NEAR_FAR_CLIP_MASK = 0x30;
+	static const uint32_t GUARD_BAND_CLIP_MASK = 0x3C0;
+
+	Vector2 guardBand = Vector2(1.f, 1.f);
+
+	void SetGuardBand(float x, float y)
+	{
+		assert(x >= 1.f && y >= 1.f);
+		guardBand = Vector2(Mathf::Max(x, 1.f), Mathf::Max(y, 1.f));
+	}
+
+	// Largest guard band the rasterizer's 32-bit edge functions can take: an edge value
+	// reaches 2 * extent^2 << subPixelBits, which has to stay below 2^30.
+	static void CalculateGuardBand(int width, int height, int subPixelBits, float& x, float& y)
+	{
+		float maxExtent = std::sqrt((float)(1 << (29 - subPixelBits)));
+		x = Mathf::Max(maxExtent / (float)width, 1.f);
+		y = Mathf::Max(maxExtent / (float)height, 1.f);
+	}
+
+	uint32_t CalculateClipCode(const Vector4& hc) const
 	{
 		uint32_t clipCode = 0x0;
 		for (auto& p : viewFrustumPlanes)
 		{
-			if (p.getClipCodeFunc(hc))
+			if (p.getClipCodeFunc(hc, guardBand))
+			{
+				clipCode |= p.cullMask;
+			}
+		}
+		for (auto& p : guardBandPlanes)
+		{
+			if (p.getClipCodeFunc(hc, guardBand))
 			{
 				clipCode |= p.cullMask;
 			}
@@ -42,7 +92,7 @@ struct Clipper
 	}
 
 	template<typename Type>
-	static std::vector<Line<Type> > ClipLine(const Type& v0, const Type& v1)
+	std::vector<Line<Type> > ClipLine(const Type& v0, const Type& v1) const
 	{
 		std::vector<Line<Type> > lines;
 		if (0 != (v0.clipCode & v1.clipCode)) return lines;
@@ -56,40 +106,76 @@ struct Clipper
 			clippedLines.clear();
 			for (auto& l : lines)
 			{
-				Clipper::ClipLineFromPlane(clippedLines, l.v0, l.v1, p);
+				ClipLineFromPlane(clippedLines, l.v0, l.v1, p);
 			}
 			std::swap(lines, clippedLines);
 		}
 		return lines;
 	}
 
+	// Guard-band clipping: only near/far and the guard-band planes split triangles. Triangles
+	// that merely cross the viewport edges are passed through, the rasterizer clamps them.
+	// Returns the number of fan triangles in polygon, 0 when the triangle is clipped away.
 	template<typename Type>
-	static std::vector<Triangle<Type> > ClipTriangle(const Type& v0, const Type& v1, const Type& v2)
+	int ClipTriangle(const Type& v0, const Type& v1, const Type& v2, ClipPolygon<Type>& polygon) const
 	{
-		std::vector<Triangle<Type> > triangles;
-		if (0 != (v0.clipCode & v1.clipCode & v2.clipCode)) return triangles;
+		polygon.vertexCount = 0;
+		if (0 != (v0.clipCode & v1.clipCode & v2.clipCode)) return 0;
+
+		uint32_t clipCode = (v0.clipCode | v1.clipCode | v2.clipCode);
+		if (0 == (clipCode & (NEAR_FAR_CLIP_MASK | GUARD_BAND_CLIP_MASK)))
+		{
+			polygon.vertices[0] = v0;
+			polygon.vertices[1] = v1;
+			polygon.vertices[2] = v2;
+			polygon.vertexCount = 3;
+			return 1;
+		}
 
-		triangles.emplace_back(v0, v1, v2);
-		if (0 == (v0.clipCode | v1.clipCode | v2.clipCode)) return triangles;
+		// Sutherland-Hodgman on positions and barycentric weights only, the varyings are
+		// interpolated once for the vertices of the final polygon
+		ClipVertex vertices[2][ClipPolygon<Type>::MAX_VERTEX_COUNT];
+		vertices[0][0] = ClipVertex(v0.position, Vector3(1.f, 0.f, 0.f), v0.clipCode, 0);
+		vertices[0][1] = ClipVertex(v1.position, Vector3(0.f, 1.f, 0.f), v1.clipCode, 1);
+		vertices[0][2] = ClipVertex(v2.position, Vector3(0.f, 0.f, 1.f), v2.clipCode, 2);
+		int vertexCount = 3;
+		int current = 0;
 
-		std::vector<Triangle<Type> > clippedTriangles;
-		for (auto& p : viewFrustumPlanes)
-		//for (int i = 0; i < 2; ++i)
+		auto clipFromPlane = [&](const Plane& p)
 		{
-			//Plane& p = viewFrustumPlanes[i];
-			clippedTriangles.clear();
-			for (auto& f : triangles)
+			if (vertexCount < 3 || 0 == (clipCode & p.cullMask)) return;
+			vertexCount = ClipPolygonFromPlane(vertices[current], vertexCount, vertices[current ^ 1], p);
+			current ^= 1;
+			clipCode = 0x0;
+			for (int i = 0; i < vertexCount; ++i) clipCode |= vertices[current][i].clipCode;
+		};
+
+		clipFromPlane(viewFrustumPlanes[0]);
+		clipFromPlane(viewFrustumPlanes[1]);
+		for (auto& p : guardBandPlanes) clipFromPlane(p);
+		if (vertexCount < 3) return 0;
+
+		const Type* sources[3] = { &v0, &v1, &v2 };
+		for (int i = 0; i < vertexCount; ++i)
+		{
+			const ClipVertex& clipVertex = vertices[current][i];
+			Type& v = polygon.vertices[i];
+			if (clipVertex.source >= 0)
 			{
-				Clipper::ClipTriangleFromPlane(clippedTriangles, f.v0, f.v1, f.v2, p);
+				v = *sources[clipVertex.source];
+				continue;
 			}
-			std::swap(triangles, clippedTriangles);
+			v = Type::TriangleInterp(v0, v1, v2, clipVertex.weights.x, clipVertex.weights.y, clipVertex.weights.z);
+			v.position = clipVertex.position;
+			v.clipCode = clipVertex.clipCode;
 		}
-		return triangles;
+		polygon.vertexCount = vertexCount;
+		return vertexCount - 2;
 	}
 
 	template<typename Type>
-	static void ClipLineFromPlane(std::vector<Line<Type> >& clippedLines,
-		const Type& v0, const Type& v1, const Plane& plane)
+	void ClipLineFromPlane(std::vector<Line<Type> >& clippedLines,
+		const Type& v0, const Type& v1, const Plane& plane) const
 	{
 		if (v0.clipCode & v1.clipCode & plane.cullMask) return;
 		else if (0 == ((v0.clipCode | v1.clipCode) & plane.cullMask))
@@ -98,80 +184,65 @@ struct Clipper
 		}
 		else if ((~v0.clipCode) & v1.clipCode & plane.cullMask)
 		{
-			float t = plane.clippingFunc(v1.position, v0.position);
+			float t = plane.clippingFunc(v1.position, v0.position, guardBand);
 			assert(0.f <= t && t <= 1.f);
-			clippedLines.emplace_back(v0, Type::LinearInterp(v1, v0, t));
+			clippedLines.emplace_back(v0, InterpVertex(v1, v0, t));
 		}
 		else if (v0.clipCode & (~v1.clipCode) & plane.cullMask)
 		{
-			float t = plane.clippingFunc(v0.position, v1.position);
+			float t = plane.clippingFunc(v0.position, v1.position, guardBand);
 			assert(0.f <= t && t <= 1.f);
-			clippedLines.emplace_back(Type::LinearInterp(v0, v1, t), v1);
+			clippedLines.emplace_back(InterpVertex(v0, v1, t), v1);
 		}
 	}
 
-	template<typename Type>
-	static void ClipTriangleFromPlane(std::vector<Triangle<Type> >& clippedTriangles,
-		const Type& v0, const Type& v1, const Type& v2, const Plane& plane)
+	// one polygon vertex while clipping, source is the input vertex it still equals or -1
+	struct ClipVertex
 	{
-		if (v0.clipCode & v1.clipCode & v2.clipCode & plane.cullMask) return;
-		else if (0 == ((v0.clipCode | v1.clipCode | v2.clipCode) & plane.cullMask))
-		{
-			clippedTriangles.emplace_back(v0, v1, v2);
-		}
-		else if ((~v0.clipCode) & v1.clipCode & v2.clipCode & plane.cullMask)
-		{
-			ClipTriangleWithTwoVertexOut(clippedTriangles, v0, v1, v2, plane);
-		}
-		else if (v0.clipCode & (~v1.clipCode) & v2.clipCode & plane.cullMask)
-		{
-			ClipTriangleWithTwoVertexOut(clippedTriangles, v1, v2, v0, plane);
-		}
-		else if (v0.clipCode & v1.clipCode & (~v2.clipCode) & plane.cullMask)
-		{
-			ClipTriangleWithTwoVertexOut(clippedTriangles, v2, v0, v1, plane);
-		}
-		else if ((~v0.clipCode) & (~v1.clipCode) & v2.clipCode & plane.cullMask)
-		{
-			ClipTriangleWithOneVertexOut(clippedTriangles, v0, v1, v2, plane);
-		}
-		else if (v0.clipCode & (~v1.clipCode) & (~v2.clipCode) & plane.cullMask)
-		{
-			ClipTriangleWithOneVertexOut(clippedTriangles, v1, v2, v0, plane);
-		}
-		else if ((~v0.clipCode) & v1.clipCode & (~v2.clipCode) & plane.cullMask)
-		{
-			ClipTriangleWithOneVertexOut(clippedTriangles, v2, v0, v1, plane);
-		}
-	}
+		Vector4 position;
+		Vector3 weights;
+		uint32_t clipCode = 0x0;
+		int source = -1;
 
-	template<typename Type>
-	static void ClipTriangleWithOneVertexOut(std::vector<Triangle<Type> >& clippedTriangles,
-		const Type& v0, const Type& v1, const Type& v2, const Plane& plane)
+		ClipVertex() = default;
+		ClipVertex(const Vector4& _position, const Vector3& _weights, uint32_t _clipCode, int _source) :
+			position(_position), weights(_weights), clipCode(_clipCode), source(_source) {}
+	};
+
+	int ClipPolygonFromPlane(const ClipVertex* input, int inputCount, ClipVertex* output, const Plane& plane) const
 	{
-		// v0 & v1 in, v2 out
-		float t1 = plane.clippingFunc(v2.position, v1.position);
-		float t0 = plane.clippingFunc(v2.position, v0.position);
-		assert(0.f <= t1 && t1 <= 1.f);
-		assert(0.f <= t0 && t0 <= 1.f);
-		Type tv0 = Type::LinearInterp(v2, v1, t1);
-		Type tv1 = Type::LinearInterp(v2, v0, t0);
-		clippedTriangles.emplace_back(v0, v1, tv0);
-		clippedTriangles.emplace_back(v0, tv0, tv1);
+		int outputCount = 0;
+		for (int i = 0; i < inputCount; ++i)
+		{
+			const ClipVertex& v0 = input[i];
+			const ClipVertex& v1 = input[(i + 1) % inputCount];
+			bool isOut0 = 0 != (v0.clipCode & plane.cullMask);
+			bool isOut1 = 0 != (v1.clipCode & plane.cullMask);
+			if (!isOut0) output[outputCount++] = v0;
+			if (isOut0 == isOut1) continue;
+
+			// always interpolate from the outside vertex, so an edge shared by two triangles
+			// is cut at the same point for both
+			const ClipVertex& out = isOut0 ? v0 : v1;
+			const ClipVertex& in = isOut0 ? v1 : v0;
+			float t = plane.clippingFunc(out.position, in.position, guardBand);
+			assert(0.f <= t && t <= 1.f);
+			ClipVertex& v = output[outputCount++];
+			v.position = Vector4::LinearInterp(out.position, in.position, t);
+			v.weights = Vector3::LinearInterp(out.weights, in.weights, t);
+			v.clipCode = CalculateClipCode(v.position);
+			v.source = -1;
+		}
+		return outputCount;
 	}
 
+	// the clip code depends on this clipper's guard band, so it is set here rather than by the vertex type
 	template<typename Type>
-	static void ClipTriangleWithTwoVertexOut(std::vector<Triangle<Type> >& clippedTriangles,
-		const Type& v0, const Type& v1, const Type& v2, const Plane& plane)
+	Type InterpVertex(const Type& v0, const Type& v1, float t) const
 	{
-		// v0 in, v1, v2 out
-		float t1 = plane.clippingFunc(v1.position, v0.position);
-		float t2 = plane.clippingFunc(v2.position, v0.position);
-		assert(0.f <= t1 && t1 <= 1.f);
-		assert(0.f <= t2 && t2 <= 1.f);
-		Type tv0 = Type::LinearInterp(v1, v0, t1);
-		Type tv1 = Type::LinearInterp(v2, v0, t2);
-		clippedTriangles.emplace_back(v0, tv0, tv1);
+		Type v = Type::LinearInterp(v0, v1, t);
+		v.clipCode = CalculateClipCode(v.position);
+		return v;
 	}
 
 	static float Clip(float f0, float w0, float f1, float w1)
@@ -0,0 +1,79 @@
+#include "command_list.h"
+#include "math/mathf.h"
+#include <typeindex>
+#include <unordered_map>
+#include <numeric>
+using namespace sr;
+
+void CommandList::Append(const CommandList& other)
+{
+	commands.insert(commands.end(), other.commands.begin(), other.commands.end());
+}
+
+void CommandList::Record(const RenderState& renderState, ShaderPtr shader, const RenderContext::ShaderCloneFunc& shaderCloneFunc,
+	const Matrix4x4& modelMatrix, RenderDataPtr renderData, int startIndex, int primitiveCount)
+{
+	assert(shader != nullptr);
+	assert(renderData != nullptr);
+
+	DrawCommand command;
+	command.renderState = renderState;
+	command.shader = shader;
+	command.shaderCloneFunc = shaderCloneFunc;
+	command.modelMatrix = modelMatrix;
+	command.light = light;
+	command.renderData = renderData;
+	command.startIndex = startIndex;
+	command.primitiveCount = primitiveCount;
+	commands.push_back(command);
+}
+
+uint64_t CommandList::CalculateSortKey(const DrawCommand& command, Camera& camera, uint32_t stateID) const
+{
+	// blended | 16 bit camera distance, reversed for blended draws | state
+	bool isTransparent = command.renderState.alphaBlend;
+	Vector3 center = command.modelMatrix.MultiplyPoint3x4(Vector3::zero);
+	float distance = Mathf::Clamp01((center - camera.transform.position).Length() / camera.zFar());
+	uint64_t depth = (uint64_t)(distance * 65535.f);
+	if (isTransparent) depth = 65535 - depth;
+
+	return ((uint64_t)(isTransparent ? 1 : 0) << 63) | (depth << 32) | stateID;
+}
+
+void CommandList::Execute(RenderContext& context) const
+{
+	assert(context.camera != nullptr);
+
+	// draws that run the same shader type share a state id, numbered in recording order
+	std::unordered_map<std::type_index, uint32_t> stateIDs;
+	std::vector<uint64_t> sortKeys(commands.size());
+	for (size_t i = 0; i < commands.size(); ++i)
+	{
+		const DrawCommand& command = commands[i];
+		auto result = stateIDs.emplace(std::type_index(typeid(*command.shader)), (uint32_t)stateIDs.size());
+		sortKeys[i] = CalculateSortKey(command, *context.camera, result.first->second);
+	}
+
+	std::vector<int> order(commands.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](int a, int b) { return sortKeys[a] < sortKeys[b]; });
+
+	RenderState contextRenderState = context.renderState;
+	Matrix4x4 contextModelMatrix = context.modelMatrix;
+	LightPtr contextLight = context.light;
+	ShaderPtr contextShader = context.GetShader();
+	RenderContext::ShaderCloneFunc contextShaderCloneFunc = context.GetCurrentShaderCloneFunc();
+	for (int index : order)
+	{
+		const DrawCommand& command = commands[index];
+		context.renderState = command.renderState;
+		context.modelMatrix = command.modelMatrix;
+		context.light = command.light;
+		context.SetShader(command.shader, command.shaderCloneFunc);
+		context.Submit(*command.renderData, command.startIndex, command.primitiveCount);
+	}
+	context.renderState = contextRenderState;
+	context.modelMatrix = contextModelMatrix;
+	context.light = contextLight;
+	if (contextShader != nullptr) context.SetShader(contextShader, contextShaderCloneFunc);
+}
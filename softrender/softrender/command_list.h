@@ -0,0 +1,80 @@
+#ifndef _SOFTRENDER_COMMAND_LIST_H_
+#define _SOFTRENDER_COMMAND_LIST_H_
+
+#include "base/header.h"
+#include "math/matrix4x4.h"
+#include "softrender/render_state.hpp"
+#include "softrender/render_data.hpp"
+#include "softrender/render_context.h"
+
+namespace sr
+{
+
+class CommandList;
+typedef std::shared_ptr<CommandList> CommandListPtr;
+
+// Records draws and replays them sorted on a RenderContext: opaque draws front to back,
+// then blended draws back to front, draws at a similar depth grouped by shader.
+// A list is not thread-safe; record one list per thread and Append them afterwards.
+class CommandList
+{
+public:
+	struct DrawCommand
+	{
+		RenderState renderState;
+		ShaderPtr shader;
+		RenderContext::ShaderCloneFunc shaderCloneFunc;
+		Matrix4x4 modelMatrix;
+		// the light set when the draw was recorded, the context's light during the draw
+		LightPtr light;
+		RenderDataPtr renderData;
+		int startIndex = 0;
+		int primitiveCount = 0;
+	};
+
+	// typed shaders are copied, so the draw keeps the uniforms it was recorded with
+	template<typename ShaderType>
+	void Draw(const RenderState& renderState, const std::shared_ptr<ShaderType>& shader, const Matrix4x4& modelMatrix,
+		RenderDataPtr renderData, int startIndex = 0, int primitiveCount = 0)
+	{
+		auto cloneFunc = RenderContext::GetShaderCloneFunc<ShaderType>();
+		ShaderPtr copy = nullptr;
+		cloneFunc(shader, copy);
+		Record(renderState, copy, cloneFunc, modelMatrix, renderData, startIndex, primitiveCount);
+	}
+	// the shader is shared, its uniforms are read when the list is executed
+	void Draw(const RenderState& renderState, ShaderPtr shader, const Matrix4x4& modelMatrix,
+		RenderDataPtr renderData, int startIndex = 0, int primitiveCount = 0)
+	{
+		Record(renderState, shader, nullptr, modelMatrix, renderData, startIndex, primitiveCount);
+	}
+
+	// the light of the draws recorded after this call, nullptr for none
+	void SetLight(LightPtr light) { this->light = light; }
+
+	void Append(const CommandList& other);
+	void Clear()
+	{
+		commands.clear();
+		light = nullptr;
+	}
+	int GetCommandCount() const { return (int)commands.size(); }
+	const DrawCommand& GetCommand(int index) const { return commands[index]; }
+
+	// Sorts against the context's camera and submits every draw with its recorded light. The
+	// list is left untouched so a frame can be replayed; the context's render state, model
+	// matrix, shader and light are restored afterwards.
+	void Execute(RenderContext& context) const;
+
+private:
+	void Record(const RenderState& renderState, ShaderPtr shader, const RenderContext::ShaderCloneFunc& shaderCloneFunc,
+		const Matrix4x4& modelMatrix, RenderDataPtr renderData, int startIndex, int primitiveCount);
+	uint64_t CalculateSortKey(const DrawCommand& command, Camera& camera, uint32_t stateID) const;
+
+	std::vector<DrawCommand> commands;
+	LightPtr light = nullptr;
+};
+
+}
+
+#endif //! _SOFTRENDER_COMMAND_LIST_H_
@@ -0,0 +1,144 @@
+#include "hiz_buffer.h"
+#include "math/mathf.h"
+#include <mutex>
+using namespace sr;
+
+const int HiZBuffer::TILE_SIZE;
+
+HiZBufferPtr HiZBuffer::GetHiZBuffer(BitmapPtr depthBuffer)
+{
+	// a live HiZ buffer keeps its depth bitmap alive, so a key is never reused while its entry is
+	static std::mutex mutex;
+	static std::map<const Bitmap*, std::weak_ptr<HiZBuffer> > hiZBuffers;
+
+	assert(depthBuffer != nullptr);
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = hiZBuffers.find(depthBuffer.get());
+	if (found != hiZBuffers.end())
+	{
+		HiZBufferPtr hiZBuffer = found->second.lock();
+		if (hiZBuffer != nullptr) return hiZBuffer;
+	}
+
+	// only sweep when a miss may be due to dead entries, lookups of live buffers stay O(log n)
+	for (auto it = hiZBuffers.begin(); it != hiZBuffers.end();)
+	{
+		if (it->second.expired()) it = hiZBuffers.erase(it);
+		else ++it;
+	}
+
+	HiZBufferPtr hiZBuffer = std::make_shared<HiZBuffer>(depthBuffer);
+	hiZBuffers[depthBuffer.get()] = hiZBuffer;
+	return hiZBuffer;
+}
+
+HiZBuffer::HiZBuffer(BitmapPtr depthBuffer)
+{
+	assert(depthBuffer != nullptr);
+	this->depthBuffer = depthBuffer;
+	tileCountX = (depthBuffer->GetWidth() + TILE_SIZE - 1) / TILE_SIZE;
+	tileCountY = (depthBuffer->GetHeight() + TILE_SIZE - 1) / TILE_SIZE;
+	tiles.resize(tileCountX * tileCountY);
+	generation = depthBuffer->GetGeneration();
+}
+
+void HiZBuffer::Reset(float depth)
+{
+	for (auto& tile : tiles)
+	{
+		tile.minDepth = depth;
+		tile.maxDepth = depth;
+		tile.isDirty = false;
+	}
+	// Reset follows the Fill that changed the depth buffer
+	generation = depthBuffer->GetGeneration();
+}
+
+void HiZBuffer::Invalidate()
+{
+	for (auto& tile : tiles) tile.isDirty = true;
+}
+
+void HiZBuffer::Sync()
+{
+	if (depthBuffer->GetGeneration() == generation) return;
+	Invalidate();
+	generation = depthBuffer->GetGeneration();
+}
+
+void HiZBuffer::WriteDepth(int x, int y, float oldDepth, float newDepth)
+{
+	depthBuffer->WriteAlpha(x, y, newDepth);
+
+	Tile& tile = GetTile(x / TILE_SIZE, y / TILE_SIZE);
+	if (tile.isDirty) return;
+
+	// growing a bound is exact; shrinking it needs a rescan, which waits for the next query
+	if (newDepth > tile.maxDepth) tile.maxDepth = newDepth;
+	else if (oldDepth >= tile.maxDepth) tile.isDirty = true;
+
+	if (newDepth < tile.minDepth) tile.minDepth = newDepth;
+	else if (oldDepth <= tile.minDepth) tile.isDirty = true;
+}
+
+bool HiZBuffer::IsOccluded(int minX, int minY, int maxX, int maxY, float nearZ, float farZ, RenderState::ZTestType zTest)
+{
+	if (zTest == RenderState::ZTestType_Always || zTest == RenderState::ZTestType_NotEqual) return false;
+
+	for (int tileY = minY / TILE_SIZE; tileY <= maxY / TILE_SIZE; ++tileY)
+	{
+		for (int tileX = minX / TILE_SIZE; tileX <= maxX / TILE_SIZE; ++tileX)
+		{
+			Tile& tile = GetTile(tileX, tileY);
+			if (tile.isDirty) RefreshTile(tileX, tileY, tile);
+
+			bool isOccluded = false;
+			switch (zTest)
+			{
+			case RenderState::ZTestType_Less:
+				isOccluded = nearZ >= tile.maxDepth;
+				break;
+			case RenderState::ZTestType_LEqual:
+				isOccluded = nearZ > tile.maxDepth;
+				break;
+			case RenderState::ZTestType_Greater:
+				isOccluded = farZ <= tile.minDepth;
+				break;
+			case RenderState::ZTestType_GEqual:
+				isOccluded = farZ < tile.minDepth;
+				break;
+			case RenderState::ZTestType_Equal:
+				isOccluded = nearZ > tile.maxDepth || farZ < tile.minDepth;
+				break;
+			default:
+				break;
+			}
+			if (!isOccluded) return false;
+		}
+	}
+	return true;
+}
+
+void HiZBuffer::RefreshTile(int tileX, int tileY, Tile& tile)
+{
+	int minX = tileX * TILE_SIZE;
+	int minY = tileY * TILE_SIZE;
+	int maxX = Mathf::Min(minX + TILE_SIZE, depthBuffer->GetWidth());
+	int maxY = Mathf::Min(minY + TILE_SIZE, depthBuffer->GetHeight());
+
+	float minDepth = depthBuffer->GetAlpha(minX, minY);
+	float maxDepth = minDepth;
+	for (int y = minY; y < maxY; ++y)
+	{
+		for (int x = minX; x < maxX; ++x)
+		{
+			float depth = depthBuffer->GetAlpha(x, y);
+			minDepth = Mathf::Min(minDepth, depth);
+			maxDepth = Mathf::Max(maxDepth, depth);
+		}
+	}
+
+	tile.minDepth = minDepth;
+	tile.maxDepth = maxDepth;
+	tile.isDirty = false;
+}
@@ -0,0 +1,61 @@
+#ifndef _SOFTRENDER_HIZ_BUFFER_H_
+#define _SOFTRENDER_HIZ_BUFFER_H_
+
+#include "base/header.h"
+#include "softrender/bitmap.h"
+#include "softrender/render_state.hpp"
+
+namespace sr
+{
+
+class HiZBuffer;
+typedef std::shared_ptr<HiZBuffer> HiZBufferPtr;
+
+// Min/max depth of every TILE_SIZE x TILE_SIZE tile of a depth buffer. The bounds are kept
+// conservative on writes and only tightened from the depth buffer when a tile is queried.
+class HiZBuffer
+{
+public:
+	static const int TILE_SIZE = 8;
+
+	explicit HiZBuffer(BitmapPtr depthBuffer);
+
+	// The HiZ buffer of depthBuffer, created on first use. Render targets sharing a depth
+	// bitmap share its HiZ buffer, so a write through one target updates the bounds of all.
+	static HiZBufferPtr GetHiZBuffer(BitmapPtr depthBuffer);
+
+	// the whole depth buffer was filled with depth
+	void Reset(float depth);
+	// the depth buffer was changed without going through WriteDepth
+	void Invalidate();
+	// invalidates when the depth bitmap was written behind this buffer's back (Fill, SetPixel,
+	// SetAlpha or GetBytes by anyone else); called before every draw that reads the bounds
+	void Sync();
+
+	// writes depth and keeps the bounds, without counting as an outside write
+	void WriteDepth(int x, int y, float oldDepth, float newDepth);
+
+	// true when no pixel in [minX, maxX] x [minY, maxY] can pass zTest with a depth in [nearZ, farZ]
+	bool IsOccluded(int minX, int minY, int maxX, int maxY, float nearZ, float farZ, RenderState::ZTestType zTest);
+
+private:
+	struct Tile
+	{
+		float minDepth = 0.f;
+		float maxDepth = 1.f;
+		bool isDirty = true;
+	};
+
+	Tile& GetTile(int tileX, int tileY) { return tiles[tileY * tileCountX + tileX]; }
+	void RefreshTile(int tileX, int tileY, Tile& tile);
+
+	BitmapPtr depthBuffer = nullptr;
+	int tileCountX = 0;
+	int tileCountY = 0;
+	std::vector<Tile> tiles;
+	uint32_t generation = 0;
+};
+
+}
+
+#endif //! _SOFTRENDER_HIZ_BUFFER_H_
@@ -0,0 +1,31 @@
+#include "index_buffer.h"
+using namespace sr;
+
+IndexBufferPtr IndexBuffer::Create(const std::vector<uint16_t>& indices)
+{
+	IndexBufferPtr indexBuffer = IndexBufferPtr(new IndexBuffer());
+	indexBuffer->format = IndexFormat_UInt16;
+	indexBuffer->indexCount = (int)indices.size();
+	indexBuffer->data.resize(indices.size() * sizeof(uint16_t));
+	if (!indices.empty()) memcpy(indexBuffer->data.data(), indices.data(), indexBuffer->data.size());
+	return indexBuffer;
+}
+
+IndexBufferPtr IndexBuffer::Create(const std::vector<uint32_t>& indices)
+{
+	uint32_t maxIndex = 0;
+	for (uint32_t index : indices) maxIndex = Mathf::Max(maxIndex, index);
+	if (maxIndex <= 0xffff)
+	{
+		// half the bandwidth for meshes of up to 65,536 vertices
+		std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+		return Create(shortIndices);
+	}
+
+	IndexBufferPtr indexBuffer = IndexBufferPtr(new IndexBuffer());
+	indexBuffer->format = IndexFormat_UInt32;
+	indexBuffer->indexCount = (int)indices.size();
+	indexBuffer->data.resize(indices.size() * sizeof(uint32_t));
+	memcpy(indexBuffer->data.data(), indices.data(), indexBuffer->data.size());
+	return indexBuffer;
+}
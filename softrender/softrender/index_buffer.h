@@ -0,0 +1,63 @@
+#ifndef _SOFTRENDER_INDEX_BUFFER_H_
+#define _SOFTRENDER_INDEX_BUFFER_H_
+
+#include "base/header.h"
+#include "softrender/srtypes.hpp"
+
+namespace sr
+{
+
+class IndexBuffer;
+typedef std::shared_ptr<IndexBuffer> IndexBufferPtr;
+
+// Immutable triangle list indices, built once and shared by any number of RenderData.
+// Each buffer stores 16-bit indices when every index fits, 32-bit ones otherwise.
+class IndexBuffer
+{
+public:
+	enum IndexFormat
+	{
+		IndexFormat_UInt16,
+		IndexFormat_UInt32,
+	};
+
+	static IndexBufferPtr Create(const std::vector<uint16_t>& indices);
+	// picks the narrowest format that holds the largest index
+	static IndexBufferPtr Create(const std::vector<uint32_t>& indices);
+
+	IndexFormat GetIndexFormat() const { return format; }
+	int GetIndexCount() const { return indexCount; }
+	int GetPrimitiveCount() const { return indexCount / 3; }
+
+	bool GetTrianglePrimitive(int id, Triangle<uint32_t>& triangle) const
+	{
+		int offset = id * 3;
+		if (offset < 0 || offset + 3 > indexCount) return false;
+		if (format == IndexFormat_UInt16)
+		{
+			const uint16_t* indices = (const uint16_t*)data.data() + offset;
+			triangle.v0 = indices[0];
+			triangle.v1 = indices[1];
+			triangle.v2 = indices[2];
+		}
+		else
+		{
+			const uint32_t* indices = (const uint32_t*)data.data() + offset;
+			triangle.v0 = indices[0];
+			triangle.v1 = indices[1];
+			triangle.v2 = indices[2];
+		}
+		return true;
+	}
+
+private:
+	IndexBuffer() = default;
+
+	std::vector<uint8_t> data;
+	IndexFormat format = IndexFormat_UInt16;
+	int indexCount = 0;
+};
+
+}
+
+#endif //! _SOFTRENDER_INDEX_BUFFER_H_
@@ -32,7 +32,8 @@ struct Mesh
 
 	std::string name;
 	std::vector<Vector3> vertices;
-	std::vector<uint16_t> indices;
+	// IndexBuffer::Create stores them as 16-bit when the mesh is small enough
+	std::vector<uint32_t> indices;
 	std::vector<Color> colors;
 	std::vector<Vector3> normals;
 	std::vector<Vector4> tangents;
@@ -2,9 +2,11 @@
 #define _SOFTRENDER_RASTERIZER_H_
 
 #include "base/header.h"
+#include "base/cpu_info.h"
 #include "math/mathf.h"
 #include "math/color.h"
 #include "softrender/srtypes.hpp"
+#include "softrender/hiz_buffer.h"
 
 namespace sr
 {
@@ -20,29 +22,69 @@ struct Rasterizer2x2Info
 {
 	int x, y;
 	uint8_t maskCode;
-#if _MATH_SIMD_INTRINSIC_
+	// quad position relative to the first vertex, where the triangle's planes are evaluated
+	float planeX, planeY;
 	SIMD_ALIGN float depth[4];
-	SIMD_ALIGN float wx[4], wy[4], wz[4];
-#else
-	float depth[4];
-	float wx[4], wy[4], wz[4];
-#endif
+	// perspective w of each pixel, the one reciprocal every attribute plane is scaled by
+	SIMD_ALIGN float w[4];
 };
 
 class Rasterizer
 {
+public:
+	enum SIMDLevel
+	{
+		SIMDLevel_Scalar = 0,
+		SIMDLevel_SSE41,
+		SIMDLevel_AVX2,
+	};
+
 private:
 	int width = 0;
 	int height = 0;
+	int subPixelBits = DEFAULT_SUBPIXEL_BITS;
+	SIMDLevel simdLevel = DetectSIMDLevel();
+	HiZBufferPtr hiZBuffer = nullptr;
+	RenderState::ZTestType hiZTest = RenderState::ZTestType_Always;
 
 public:
+	static const int BLOCK_SIZE = 8;
+	static const int DEFAULT_SUBPIXEL_BITS = 4;
+	static const int MAX_SUBPIXEL_BITS = 8;
+
 	Rasterizer() = default;
 
+	static SIMDLevel DetectSIMDLevel()
+	{
+		if (CPUInfo::HasAVX2()) return SIMDLevel_AVX2;
+		if (CPUInfo::HasSSE41()) return SIMDLevel_SSE41;
+		return SIMDLevel_Scalar;
+	}
+
+	// levels the cpu doesn't support fall back to the best supported one
+	void SetSIMDLevel(SIMDLevel level) { simdLevel = Mathf::Min(level, DetectSIMDLevel()); }
+	SIMDLevel GetSIMDLevel() const { return simdLevel; }
+
+	// vertices are snapped to a 1 / (1 << bits) pixel grid, see Projection::CalculateViewProjection
+	void SetSubPixelBits(int bits)
+	{
+		assert(bits >= 0 && bits <= MAX_SUBPIXEL_BITS);
+		subPixelBits = Mathf::Clamp(bits, 0, (int)MAX_SUBPIXEL_BITS);
+	}
+	int GetSubPixelBits() const { return subPixelBits; }
+
 	void Initlize(int width, int height)
 	{
 		this->width = width;
 		this->height = height;
 	}
+
+	// blocks the hiZ buffer proves to fail zTest are skipped before any quad is emitted
+	void SetHiZBuffer(HiZBufferPtr hiZBuffer, RenderState::ZTestType zTest)
+	{
+		this->hiZBuffer = hiZBuffer;
+		this->hiZTest = zTest;
+	}
 	
 	template<typename Type>
 	using Render2x2Func = std::function<void(const Type&, const Rasterizer2x2Info&)>;
@@ -79,149 +121,451 @@ public:
 	//	}
 	//}
 
-	template<typename DrawDataType>
-	void RasterizerTriangle(Triangle<Projection> projection, Render2x2Func<DrawDataType> renderFunc, const DrawDataType& renderData)
+	// pixel range whose samples lie inside the triangle's bounds; false when it holds no sample
+	bool CalculateBoundingBox(const Triangle<Projection>& projection, int& minX, int& minY, int& maxX, int& maxY) const
 	{
 		const Projection& p0 = projection.v0;
 		const Projection& p1 = projection.v1;
 		const Projection& p2 = projection.v2;
 
-		int minX = Mathf::Min(p0.x, p1.x, p2.x);
-		int minY = Mathf::Min(p0.y, p1.y, p2.y);
-		int maxX = Mathf::Max(p0.x, p1.x, p2.x);
-		int maxY = Mathf::Max(p0.y, p1.y, p2.y);
+		int subPixelMask = (1 << subPixelBits) - 1;
+		minX = (Mathf::Min(p0.x, p1.x, p2.x) + subPixelMask) >> subPixelBits;
+		minY = (Mathf::Min(p0.y, p1.y, p2.y) + subPixelMask) >> subPixelBits;
+		maxX = Mathf::Max(p0.x, p1.x, p2.x) >> subPixelBits;
+		maxY = Mathf::Max(p0.y, p1.y, p2.y) >> subPixelBits;
 
 		if (minX < 0) minX = 0;
 		if (minY < 0) minY = 0;
 		if (maxX >= width) maxX = width - 1;
 		if (maxY >= height) maxY = height - 1;
 
-		if (maxX < minX) return;
-		if (maxY < minY) return;
+		return minX <= maxX && minY <= maxY;
+	}
 
-		int dx01 = p1.x - p0.x;
-		int dx12 = p2.x - p1.x;
-		int dx20 = p0.x - p2.x;
+	// zero-area triangles and triangles that cover no pixel sample never reach the pixel stage
+	bool IsTriangleCulled(const Triangle<Projection>& projection) const
+	{
+		if (Projection::Orient2D(projection.v0, projection.v1, projection.v2) == 0) return true;
 
-		int dy01 = p1.y - p0.y;
-		int dy12 = p2.y - p1.y;
-		int dy20 = p0.y - p2.y;
+		int minX, minY, maxX, maxY;
+		return !CalculateBoundingBox(projection, minX, minY, maxX, maxY);
+	}
 
-		int startW0 = Projection::Orient2D(p1.x, p1.y, p0.x, p0.y, minX, minY);
-		int startW1 = Projection::Orient2D(p2.x, p2.y, p1.x, p1.y, minX, minY);
-		int startW2 = Projection::Orient2D(p0.x, p0.y, p2.x, p2.y, minX, minY);
+	// std::function convenience entry points; they forward to the templated sink versions below
+	template<typename DrawDataType>
+	void RasterizerTriangle(const Triangle<Projection>& projection, const Render2x2Func<DrawDataType>& renderFunc, const DrawDataType& renderData)
+	{
+		RasterizerTriangle<DrawDataType>(projection, renderFunc, renderData, 0, 0, width - 1, height - 1);
+	}
 
-		if (!(dy01 > 0 || (dy01 == 0 && dx01 < 0))) startW0 -= 1;
-		if (!(dy12 > 0 || (dy12 == 0 && dx12 < 0))) startW1 -= 1;
-		if (!(dy20 > 0 || (dy20 == 0 && dx20 < 0))) startW2 -= 1;
+	template<typename DrawDataType>
+	void RasterizerTriangle(const Triangle<Projection>& projection, const Render2x2Func<DrawDataType>& renderFunc, const DrawDataType& renderData,
+		int clipMinX, int clipMinY, int clipMaxX, int clipMaxY)
+	{
+		auto sink = [&renderFunc, &renderData](const Rasterizer2x2Info& info) { renderFunc(renderData, info); };
+		RasterizerTriangle(projection, sink, clipMinX, clipMinY, clipMaxX, clipMaxY);
+	}
 
-		Rasterizer2x2Info info;
-#if _MATH_SIMD_INTRINSIC_
-		static __m128 _mf_one = _mm_set1_ps(1.f);
-
-		__m128i mi_w0_delta = _mm_setr_epi32(0, dy01, -dx01, dy01 - dx01);
-		__m128i mi_w1_delta = _mm_setr_epi32(0, dy12, -dx12, dy12 - dx12);
-		__m128i mi_w2_delta = _mm_setr_epi32(0, dy20, -dx20, dy20 - dx20);
-
-		__m128 mf_p0_invW = _mm_load1_ps(&(p0.invW));
-		__m128 mf_p1_invW = _mm_load1_ps(&(p1.invW));
-		__m128 mf_p2_invW = _mm_load1_ps(&(p2.invW));
-#else
-		int i_w0_delta[4] = { 0, dy01, -dx01, dy01 - dx01 };
-		int i_w1_delta[4] = { 0, dy12, -dx12, dy12 - dx12 };
-		int i_w2_delta[4] = { 0, dy20, -dx20, dy20 - dx20 };
-#endif
+	// renderFunc is any callable taking (const Rasterizer2x2Info&), called once per covered quad.
+	// It is a template parameter so the sink can be inlined into the traversal loops.
+	template<typename RenderFuncType>
+	void RasterizerTriangle(const Triangle<Projection>& projection, const RenderFuncType& renderFunc)
+	{
+		RasterizerTriangle(projection, renderFunc, 0, 0, width - 1, height - 1);
+	}
 
-		for (int y = minY; y <= maxY; y += 2)
+	// Emits only the pixels inside the clip rect (used for tiles). Quads stay aligned to the
+	// triangle's bounding box and the kernels evaluate the planes per quad, so every pixel gets
+	// the same coverage, w and depth as in an unclipped traversal.
+	template<typename RenderFuncType>
+	void RasterizerTriangle(const Triangle<Projection>& projection, const RenderFuncType& renderFunc,
+		int clipMinX, int clipMinY, int clipMaxX, int clipMaxY)
+	{
+		const Projection& p0 = projection.v0;
+		const Projection& p1 = projection.v1;
+		const Projection& p2 = projection.v2;
+
+		int minX, minY, maxX, maxY;
+		if (!CalculateBoundingBox(projection, minX, minY, maxX, maxY)) return;
+
+		int startX = minX;
+		int startY = minY;
+		if (clipMinX > minX) startX += (clipMinX - minX) & ~1;
+		if (clipMinY > minY) startY += (clipMinY - minY) & ~1;
+		int endX = Mathf::Min(maxX, clipMaxX);
+		int endY = Mathf::Min(maxY, clipMaxY);
+		if (endX < startX) return;
+		if (endY < startY) return;
+		if (Projection::Orient2D(p0, p1, p2) == 0) return;
+
+		TriangleSetup setup;
+		setup.maxX = maxX;
+		setup.maxY = maxY;
+		setup.clipMinX = clipMinX;
+		setup.clipMinY = clipMinY;
+		setup.clipMaxX = clipMaxX;
+		setup.clipMaxY = clipMaxY;
+
+		int dx01 = setup.dx01 = p1.x - p0.x;
+		int dx12 = setup.dx12 = p2.x - p1.x;
+		int dx20 = setup.dx20 = p0.x - p2.x;
+
+		int dy01 = setup.dy01 = p1.y - p0.y;
+		int dy12 = setup.dy12 = p2.y - p1.y;
+		int dy20 = setup.dy20 = p0.y - p2.y;
+
+		// 1 / w and z / w are linear in screen space, depth is their ratio
+		PlaneSetup planeSetup(p0, p1, p2, subPixelBits);
+		setup.x0 = planeSetup.x0;
+		setup.y0 = planeSetup.y0;
+		setup.invW = planeSetup.Calculate(p0.invW, p1.invW, p2.invW);
+		setup.zOverW = planeSetup.Calculate(p0.z * p0.invW, p1.z * p1.invW, p2.z * p2.invW);
+
+		// perspective-correct depth stays within the vertex depths, clamping keeps rounding from
+		// breaking the bounds the hiZ test relies on
+		float nearZ = setup.nearZ = Mathf::Min(p0.z, p1.z, p2.z);
+		float farZ = setup.farZ = Mathf::Max(p0.z, p1.z, p2.z);
+
+		int sampleX = startX << subPixelBits;
+		int sampleY = startY << subPixelBits;
+		int64_t edge0 = Projection::Orient2D(p1.x, p1.y, p0.x, p0.y, sampleX, sampleY);
+		int64_t edge1 = Projection::Orient2D(p2.x, p2.y, p1.x, p1.y, sampleX, sampleY);
+		int64_t edge2 = Projection::Orient2D(p0.x, p0.y, p2.x, p2.y, sampleX, sampleY);
+
+		if (!(dy01 > 0 || (dy01 == 0 && dx01 < 0))) edge0 -= 1;
+		if (!(dy12 > 0 || (dy12 == 0 && dx12 < 0))) edge1 -= 1;
+		if (!(dy20 > 0 || (dy20 == 0 && dx20 < 0))) edge2 -= 1;
+
+		// Samples sit on whole pixels, so the edge value is (w << subPixelBits) + r with
+		// 0 <= r < (1 << subPixelBits), and it is >= 0 exactly when w is. Stepping w by the
+		// fixed-point deltas per pixel keeps the traversal in 32 bits.
+		int startW0 = (int)(edge0 >> subPixelBits);
+		int startW1 = (int)(edge1 >> subPixelBits);
+		int startW2 = (int)(edge2 >> subPixelBits);
+
+		// coarse pass: classify BLOCK_SIZE x BLOCK_SIZE blocks by their corners, then walk
+		// only the blocks that touch the triangle, skipping per-pixel tests for covered blocks
+		const int blockStep = BLOCK_SIZE - 1;
+		for (int blockY = startY; blockY <= endY; blockY += BLOCK_SIZE)
 		{
-			int w0 = startW0;
-			int w1 = startW1;
-			int w2 = startW2;
+			int blockW0 = startW0;
+			int blockW1 = startW1;
+			int blockW2 = startW2;
 
-			for (int x = minX; x <= maxX; x += 2)
+			for (int blockX = startX; blockX <= endX; blockX += BLOCK_SIZE)
 			{
-				info.maskCode = 0x00;
-#if _MATH_SIMD_INTRINSIC_
-				__m128i mi_w0 = _mm_add_epi32(_mm_set1_epi32(w0), mi_w0_delta);
-				__m128i mi_w1 = _mm_add_epi32(_mm_set1_epi32(w1), mi_w1_delta);
-				__m128i mi_w2 = _mm_add_epi32(_mm_set1_epi32(w2), mi_w2_delta);
-
-				__m128i mi_or_w = _mm_or_si128(_mm_or_si128(mi_w0, mi_w1), mi_w2);
-				SIMD_ALIGN static int or_w[4];
-				_mm_store_si128((__m128i*)or_w, mi_or_w);
-				if (or_w[0] >= 0) info.maskCode |= 0x1;
-				if (or_w[1] >= 0) info.maskCode |= 0x2;
-				if (or_w[2] >= 0) info.maskCode |= 0x4;
-				if (or_w[3] >= 0) info.maskCode |= 0x8;
-				if (x + 1 >= maxX) info.maskCode &= ~0xA;
-				if (y + 1 >= maxY) info.maskCode &= ~0xC;
+				BlockCoverage c0 = ClassifyBlock(blockW0, dy01, -dx01, blockStep);
+				BlockCoverage c1 = ClassifyBlock(blockW1, dy12, -dx12, blockStep);
+				BlockCoverage c2 = ClassifyBlock(blockW2, dy20, -dx20, blockStep);
 
-				if (info.maskCode != 0)
+				if (c0 != BlockCoverage_Outside && c1 != BlockCoverage_Outside && c2 != BlockCoverage_Outside)
 				{
-					__m128 mf_w0 = _mm_cvtepi32_ps(mi_w0);
-					__m128 mf_w1 = _mm_cvtepi32_ps(mi_w1);
-					__m128 mf_w2 = _mm_cvtepi32_ps(mi_w2);
-
-					__m128 mf_tmp0 = _mm_mul_ps(mf_w1, mf_p0_invW);
-					__m128 mf_tmp1 = _mm_mul_ps(mf_w2, mf_p1_invW);
-					__m128 mf_tmp2 = _mm_mul_ps(mf_w0, mf_p2_invW);
-					//__m128 mf_invw = _mm_rcp_ps(_mm_add_ps(_mm_add_ps(mf_x, mf_y), mf_z));
-					__m128 mf_invSum = _mm_div_ps(_mf_one, _mm_add_ps(_mm_add_ps(mf_tmp0, mf_tmp1), mf_tmp2));
-					_mm_store_ps(info.wx, _mm_mul_ps(mf_tmp0, mf_invSum));
-					_mm_store_ps(info.wy, _mm_mul_ps(mf_tmp1, mf_invSum));
-					_mm_store_ps(info.wz, _mm_mul_ps(mf_tmp2, mf_invSum));
+					bool isBlockCovered = (c0 == BlockCoverage_Inside && c1 == BlockCoverage_Inside && c2 == BlockCoverage_Inside);
+					int blockMaxX = Mathf::Min(blockX + blockStep, endX);
+					int blockMaxY = Mathf::Min(blockY + blockStep, endY);
+					bool isOccluded = hiZBuffer != nullptr && hiZBuffer->IsOccluded(Mathf::Max(blockX, clipMinX), Mathf::Max(blockY, clipMinY),
+						blockMaxX, blockMaxY, nearZ, farZ, hiZTest);
 
-					for (int i = 0; i < 4; ++i)
+					if (!isOccluded)
 					{
-#else
+						switch (simdLevel)
+						{
+#if _SIMD_X86_
+						case SIMDLevel_AVX2:
+							RasterizeBlockAVX2(setup, blockX, blockY, blockMaxX, blockMaxY,
+								blockW0, blockW1, blockW2, isBlockCovered, renderFunc);
+							break;
+						case SIMDLevel_SSE41:
+							RasterizeBlockSSE41(setup, blockX, blockY, blockMaxX, blockMaxY,
+								blockW0, blockW1, blockW2, isBlockCovered, renderFunc);
+							break;
+#endif
+						default:
+							RasterizeBlockScalar(setup, blockX, blockY, blockMaxX, blockMaxY,
+								blockW0, blockW1, blockW2, isBlockCovered, renderFunc);
+							break;
+						}
+					}
+				}
+
+				blockW0 += dy01 * BLOCK_SIZE;
+				blockW1 += dy12 * BLOCK_SIZE;
+				blockW2 += dy20 * BLOCK_SIZE;
+			}
+
+			startW0 -= dx01 * BLOCK_SIZE;
+			startW1 -= dx12 * BLOCK_SIZE;
+			startW2 -= dx20 * BLOCK_SIZE;
+		}
+	}
+
+	enum BlockCoverage
+	{
+		BlockCoverage_Outside,
+		BlockCoverage_Partial,
+		BlockCoverage_Inside
+	};
+
+	// w is the edge function at the block's top-left pixel, stepX/stepY its per-pixel increments
+	static BlockCoverage ClassifyBlock(int w, int stepX, int stepY, int blockStep)
+	{
+		int w10 = w + stepX * blockStep;
+		int w01 = w + stepY * blockStep;
+		int w11 = w10 + stepY * blockStep;
+		if ((w & w10 & w01 & w11) < 0) return BlockCoverage_Outside;
+		if ((w | w10 | w01 | w11) >= 0) return BlockCoverage_Inside;
+		return BlockCoverage_Partial;
+	}
+
+private:
+	struct TriangleSetup
+	{
+		int maxX, maxY;
+		int clipMinX, clipMinY, clipMaxX, clipMaxY;
+		int dx01, dx12, dx20;
+		int dy01, dy12, dy20;
+		float x0, y0;
+		PlaneEquation invW;
+		PlaneEquation zOverW;
+		float nearZ, farZ;
+	};
+
+	// pixels of the quad at (x, y) that the bounding box or clip rect rejects, whatever the coverage
+	static uint8_t QuadBoundsMask(const TriangleSetup& setup, int x, int y)
+	{
+		uint8_t mask = 0xF;
+		if (x + 1 > setup.maxX) mask &= ~0xA;
+		if (y + 1 > setup.maxY) mask &= ~0xC;
+		if (x < setup.clipMinX) mask &= ~0x5;
+		if (x + 1 > setup.clipMaxX) mask &= ~0xA;
+		if (y < setup.clipMinY) mask &= ~0x3;
+		if (y + 1 > setup.clipMaxY) mask &= ~0xC;
+		return mask;
+	}
+
+	template<typename RenderFuncType>
+	static void RasterizeBlockScalar(const TriangleSetup& s, int blockX, int blockY, int blockMaxX, int blockMaxY,
+		int rowW0, int rowW1, int rowW2, bool isBlockCovered, const RenderFuncType& renderFunc)
+	{
+		int i_w0_delta[4] = { 0, s.dy01, -s.dx01, s.dy01 - s.dx01 };
+		int i_w1_delta[4] = { 0, s.dy12, -s.dx12, s.dy12 - s.dx12 };
+		int i_w2_delta[4] = { 0, s.dy20, -s.dx20, s.dy20 - s.dx20 };
+		float f_invW_delta[4] = { 0.f, s.invW.dx, s.invW.dy, s.invW.dx + s.invW.dy };
+		float f_zOverW_delta[4] = { 0.f, s.zOverW.dx, s.zOverW.dy, s.zOverW.dx + s.zOverW.dy };
+
+		Rasterizer2x2Info info;
+		for (int y = blockY; y <= blockMaxY; y += 2)
+		{
+			int w0 = rowW0;
+			int w1 = rowW1;
+			int w2 = rowW2;
+
+			// planes are evaluated at every quad rather than stepped, so a pixel gets the same
+			// value whatever block, tile or kernel it is rasterized in
+			info.planeY = (float)y - s.y0;
+
+			for (int x = blockX; x <= blockMaxX; x += 2)
+			{
+				float planeX = (float)x - s.x0;
 				int i_w0[4], i_w1[4], i_w2[4];
+				info.maskCode = isBlockCovered ? 0xF : 0x0;
 				for (int i = 0; i < 4; ++i)
 				{
 					i_w0[i] = w0 + i_w0_delta[i];
 					i_w1[i] = w1 + i_w1_delta[i];
 					i_w2[i] = w2 + i_w2_delta[i];
-					if ((i_w0[i] | i_w1[i] | i_w2[i]) >= 0) info.maskCode |= (1 << i);
+					if (!isBlockCovered && (i_w0[i] | i_w1[i] | i_w2[i]) >= 0) info.maskCode |= (1 << i);
 				}
-				if (x + 1 >= maxX) info.maskCode &= ~0xA;
-				if (y + 1 >= maxY) info.maskCode &= ~0xC;
+				info.maskCode &= QuadBoundsMask(s, x, y);
 
 				if (info.maskCode != 0)
 				{
+					float invW = s.invW.Evaluate(planeX, info.planeY);
+					float zOverW = s.zOverW.Evaluate(planeX, info.planeY);
 					for (int i = 0; i < 4; ++i)
 					{
-						float f_w0 = (float)i_w0[i];
-						float f_w1 = (float)i_w1[i];
-						float f_w2 = (float)i_w2[i];
-
-						info.wx[i] = f_w1 * p0.invW;
-						info.wy[i] = f_w2 * p1.invW;
-						info.wz[i] = f_w0 * p2.invW;
-						float f_invSum = 1.f / (info.wx[i] + info.wy[i] + info.wz[i]);
-						info.wx[i] *= f_invSum;
-						info.wy[i] *= f_invSum;
-						info.wz[i] *= f_invSum;
-#endif
-						info.depth[i] = Mathf::TriangleInterp(p0.z, p1.z, p2.z, info.wx[i], info.wy[i], info.wz[i]);
+						info.w[i] = 1.f / (invW + f_invW_delta[i]);
+						info.depth[i] = Mathf::Clamp((zOverW + f_zOverW_delta[i]) * info.w[i], s.nearZ, s.farZ);
 					}
 
 					info.x = x;
 					info.y = y;
-					renderFunc(renderData, info);
+					info.planeX = planeX;
+					renderFunc(info);
 				}
 
+				w0 += s.dy01 * 2;
+				w1 += s.dy12 * 2;
+				w2 += s.dy20 * 2;
+			}
+
+			rowW0 -= s.dx01 * 2;
+			rowW1 -= s.dx12 * 2;
+			rowW2 -= s.dx20 * 2;
+		}
+	}
+
+#if _SIMD_X86_
+	// one 2x2 quad per step
+	template<typename RenderFuncType>
+	SIMD_TARGET_SSE41 static void RasterizeBlockSSE41(const TriangleSetup& s, int blockX, int blockY, int blockMaxX, int blockMaxY,
+		int rowW0, int rowW1, int rowW2, bool isBlockCovered, const RenderFuncType& renderFunc)
+	{
+		__m128i mi_w0_delta = _mm_setr_epi32(0, s.dy01, -s.dx01, s.dy01 - s.dx01);
+		__m128i mi_w1_delta = _mm_setr_epi32(0, s.dy12, -s.dx12, s.dy12 - s.dx12);
+		__m128i mi_w2_delta = _mm_setr_epi32(0, s.dy20, -s.dx20, s.dy20 - s.dx20);
+
+		__m128 mf_one = _mm_set1_ps(1.f);
+		__m128 mf_invW_delta = _mm_setr_ps(0.f, s.invW.dx, s.invW.dy, s.invW.dx + s.invW.dy);
+		__m128 mf_zOverW_delta = _mm_setr_ps(0.f, s.zOverW.dx, s.zOverW.dy, s.zOverW.dx + s.zOverW.dy);
+		__m128 mf_nearZ = _mm_set1_ps(s.nearZ);
+		__m128 mf_farZ = _mm_set1_ps(s.farZ);
+
+		Rasterizer2x2Info info;
+		for (int y = blockY; y <= blockMaxY; y += 2)
+		{
+			int w0 = rowW0;
+			int w1 = rowW1;
+			int w2 = rowW2;
+
+			info.planeY = (float)y - s.y0;
+
+			for (int x = blockX; x <= blockMaxX; x += 2)
+			{
+				float planeX = (float)x - s.x0;
+				__m128i mi_w0 = _mm_add_epi32(_mm_set1_epi32(w0), mi_w0_delta);
+				__m128i mi_w1 = _mm_add_epi32(_mm_set1_epi32(w1), mi_w1_delta);
+				__m128i mi_w2 = _mm_add_epi32(_mm_set1_epi32(w2), mi_w2_delta);
+
+				// a pixel is covered when no edge function has its sign bit set
+				int coverage = 0xF;
+				if (!isBlockCovered)
+				{
+					__m128i mi_or_w = _mm_or_si128(_mm_or_si128(mi_w0, mi_w1), mi_w2);
+					coverage = ~_mm_movemask_ps(_mm_castsi128_ps(mi_or_w)) & 0xF;
+				}
+				info.maskCode = (uint8_t)coverage & QuadBoundsMask(s, x, y);
+
+				if (info.maskCode != 0)
+				{
+					float invW = s.invW.Evaluate(planeX, info.planeY);
+					float zOverW = s.zOverW.Evaluate(planeX, info.planeY);
+					__m128 mf_w = _mm_div_ps(mf_one, _mm_add_ps(_mm_set1_ps(invW), mf_invW_delta));
+					__m128 mf_depth = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(zOverW), mf_zOverW_delta), mf_w);
+					mf_depth = _mm_min_ps(_mm_max_ps(mf_depth, mf_nearZ), mf_farZ);
+					_mm_store_ps(info.w, mf_w);
+					_mm_store_ps(info.depth, mf_depth);
+
+					info.x = x;
+					info.y = y;
+					info.planeX = planeX;
+					renderFunc(info);
+				}
 
-				w0 += dy01 * 2;
-				w1 += dy12 * 2;
-				w2 += dy20 * 2;
+				w0 += s.dy01 * 2;
+				w1 += s.dy12 * 2;
+				w2 += s.dy20 * 2;
 			}
 
-			startW0 -= dx01 * 2;
-			startW1 -= dx12 * 2;
-			startW2 -= dx20 * 2;
+			rowW0 -= s.dx01 * 2;
+			rowW1 -= s.dx12 * 2;
+			rowW2 -= s.dx20 * 2;
 		}
 	}
 
+	// two adjacent quads (a 4x2 pixel block) per step: lanes 0-3 are the quad at x, lanes 4-7 the quad at x + 2
+	template<typename RenderFuncType>
+	SIMD_TARGET_AVX2 static void RasterizeBlockAVX2(const TriangleSetup& s, int blockX, int blockY, int blockMaxX, int blockMaxY,
+		int rowW0, int rowW1, int rowW2, bool isBlockCovered, const RenderFuncType& renderFunc)
+	{
+		__m256i mi_w0_delta = _mm256_setr_epi32(0, s.dy01, -s.dx01, s.dy01 - s.dx01,
+			s.dy01 * 2, s.dy01 * 3, s.dy01 * 2 - s.dx01, s.dy01 * 3 - s.dx01);
+		__m256i mi_w1_delta = _mm256_setr_epi32(0, s.dy12, -s.dx12, s.dy12 - s.dx12,
+			s.dy12 * 2, s.dy12 * 3, s.dy12 * 2 - s.dx12, s.dy12 * 3 - s.dx12);
+		__m256i mi_w2_delta = _mm256_setr_epi32(0, s.dy20, -s.dx20, s.dy20 - s.dx20,
+			s.dy20 * 2, s.dy20 * 3, s.dy20 * 2 - s.dx20, s.dy20 * 3 - s.dx20);
+
+		__m256 mf_one = _mm256_set1_ps(1.f);
+		const PlaneEquation& pw = s.invW;
+		const PlaneEquation& pz = s.zOverW;
+		// both quads step from their own origin, as in the SSE4.1 and scalar kernels
+		__m256 mf_invW_delta = _mm256_setr_ps(0.f, pw.dx, pw.dy, pw.dx + pw.dy,
+			0.f, pw.dx, pw.dy, pw.dx + pw.dy);
+		__m256 mf_zOverW_delta = _mm256_setr_ps(0.f, pz.dx, pz.dy, pz.dx + pz.dy,
+			0.f, pz.dx, pz.dy, pz.dx + pz.dy);
+		__m256 mf_nearZ = _mm256_set1_ps(s.nearZ);
+		__m256 mf_farZ = _mm256_set1_ps(s.farZ);
+
+		Rasterizer2x2Info info;
+		for (int y = blockY; y <= blockMaxY; y += 2)
+		{
+			int w0 = rowW0;
+			int w1 = rowW1;
+			int w2 = rowW2;
+
+			info.planeY = (float)y - s.y0;
+
+			for (int x = blockX; x <= blockMaxX; x += 4)
+			{
+				float planeX = (float)x - s.x0;
+				__m256i mi_w0 = _mm256_add_epi32(_mm256_set1_epi32(w0), mi_w0_delta);
+				__m256i mi_w1 = _mm256_add_epi32(_mm256_set1_epi32(w1), mi_w1_delta);
+				__m256i mi_w2 = _mm256_add_epi32(_mm256_set1_epi32(w2), mi_w2_delta);
+
+				int coverage = 0xFF;
+				if (!isBlockCovered)
+				{
+					__m256i mi_or_w = _mm256_or_si256(_mm256_or_si256(mi_w0, mi_w1), mi_w2);
+					coverage = ~_mm256_movemask_ps(_mm256_castsi256_ps(mi_or_w)) & 0xFF;
+				}
+				uint8_t maskCode0 = (uint8_t)(coverage & 0xF) & QuadBoundsMask(s, x, y);
+				uint8_t maskCode1 = (x + 2 <= blockMaxX) ? ((uint8_t)(coverage >> 4) & QuadBoundsMask(s, x + 2, y)) : 0;
 
+				if ((maskCode0 | maskCode1) != 0)
+				{
+					float invW0 = pw.Evaluate(planeX, info.planeY);
+					float planeX1 = (float)(x + 2) - s.x0;
+					float invW1 = pw.Evaluate(planeX1, info.planeY);
+					float zOverW0 = pz.Evaluate(planeX, info.planeY);
+					float zOverW1 = pz.Evaluate(planeX1, info.planeY);
+					__m256 mf_invW = _mm256_setr_ps(invW0, invW0, invW0, invW0, invW1, invW1, invW1, invW1);
+					__m256 mf_zOverW = _mm256_setr_ps(zOverW0, zOverW0, zOverW0, zOverW0, zOverW1, zOverW1, zOverW1, zOverW1);
+					__m256 mf_w = _mm256_div_ps(mf_one, _mm256_add_ps(mf_invW, mf_invW_delta));
+					__m256 mf_depth = _mm256_mul_ps(_mm256_add_ps(mf_zOverW, mf_zOverW_delta), mf_w);
+					mf_depth = _mm256_min_ps(_mm256_max_ps(mf_depth, mf_nearZ), mf_farZ);
+
+					info.y = y;
+					if (maskCode0 != 0)
+					{
+						_mm_store_ps(info.w, _mm256_castps256_ps128(mf_w));
+						_mm_store_ps(info.depth, _mm256_castps256_ps128(mf_depth));
+						info.x = x;
+						info.planeX = planeX;
+						info.maskCode = maskCode0;
+						renderFunc(info);
+					}
+					if (maskCode1 != 0)
+					{
+						_mm_store_ps(info.w, _mm256_extractf128_ps(mf_w, 1));
+						_mm_store_ps(info.depth, _mm256_extractf128_ps(mf_depth, 1));
+						info.x = x + 2;
+						info.planeX = planeX1;
+						info.maskCode = maskCode1;
+						renderFunc(info);
+					}
+				}
+
+				w0 += s.dy01 * 4;
+				w1 += s.dy12 * 4;
+				w2 += s.dy20 * 4;
+			}
+
+			rowW0 -= s.dx01 * 2;
+			rowW1 -= s.dx12 * 2;
+			rowW2 -= s.dx20 * 2;
+		}
+	}
+#endif
 };
 
 }
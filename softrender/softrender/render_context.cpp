@@ -0,0 +1,908 @@
+#include "render_context.h"
+
+namespace sr
+{
+
+const int RenderContext::TILE_SIZE;
+const int RenderContext::VERTEX_CHUNK_SIZE;
+
+// uniform inputs compared member by member, padding and union bytes never count as a change
+template<typename Type>
+static bool IsSameInput(const Type& a, const Type& b) { return a == b; }
+
+static bool IsSameInput(const Vector3& a, const Vector3& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool IsSameInput(const Quaternion& a, const Quaternion& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+static bool IsSameInput(const Color& a, const Color& b)
+{
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static bool IsSameInput(const Transform& a, const Transform& b)
+{
+	return IsSameInput(a.position, b.position) && IsSameInput(a.rotation, b.rotation) && IsSameInput(a.scale, b.scale);
+}
+
+static bool IsSameInput(const Matrix4x4& a, const Matrix4x4& b)
+{
+	for (int i = 0; i < 16; ++i)
+	{
+		if (a.m[i] != b.m[i]) return false;
+	}
+	return true;
+}
+
+// returns whether the cached copy changed
+template<typename Type>
+static bool UpdateInput(Type& cached, const Type& value)
+{
+	if (IsSameInput(cached, value)) return false;
+	cached = value;
+	return true;
+}
+
+void RenderContext::Initialize(int width, int height)
+{
+	defaultRenderTarget = std::make_shared<RenderTexture>(width, height);
+	SetRenderTarget(defaultRenderTarget);
+}
+
+void RenderContext::SetRenderTarget(RenderTexturePtr target)
+{
+	if (target == nullptr) renderTarget = defaultRenderTarget;
+	else renderTarget = target;
+
+	colorBuffer = renderTarget->GetColorBuffer();
+	depthBuffer = renderTarget->GetDepthBuffer();
+	hiZBuffer = renderTarget->GetHiZBuffer();
+}
+
+RenderTexturePtr RenderContext::GetRenderTarget()
+{
+	return renderTarget;
+}
+
+void RenderContext::ClearStencilBuffer(uint8_t stencil)
+{
+	if (stencilBuffer == nullptr)
+	{
+		stencilBuffer = std::make_shared<StencilBuffer>(renderTarget->GetWidth(), renderTarget->GetHeight());
+	}
+	stencilBuffer->Fill(stencil);
+}
+
+StencilBufferPtr RenderContext::GetStencilBuffer()
+{
+	return stencilBuffer;
+}
+
+void RenderContext::SetThreadCount(int threadCount)
+{
+	if (threadCount > 1) threadPool = std::make_shared<ThreadPool>(threadCount);
+	else threadPool = nullptr;
+}
+
+int RenderContext::GetThreadCount() const
+{
+	return threadPool != nullptr ? threadPool->GetThreadCount() : 1;
+}
+
+void RenderContext::SetSubPixelBits(int bits)
+{
+	rasterizer.SetSubPixelBits(bits);
+}
+
+void RenderContext::SetGuardBandClipping(bool enable)
+{
+	isGuardBandClipping = enable;
+}
+
+void RenderContext::SetVertexShadingMode(VertexShadingMode mode)
+{
+	vertexShadingMode = mode;
+}
+
+void RenderContext::Submit(int startIndex/* = 0*/, int primitiveCount/* = 0*/)
+{
+	Submit(renderData, startIndex, primitiveCount);
+}
+
+void RenderContext::Submit(RenderData& data, int startIndex/* = 0*/, int primitiveCount/* = 0*/)
+{
+	assert(camera != nullptr);
+
+	bool needsClipping = true;
+	UpdateCameraUniforms();
+	if (CullBounds(data, UpdateObjectUniforms(modelMatrix), needsClipping)) return;
+
+	PrepareDraw(data, startIndex, primitiveCount);
+	SetInstance(0, nullptr);
+	DrawInstance(data, startIndex, primitiveCount, needsClipping);
+}
+
+void RenderContext::SubmitInstanced(int instanceCount, const InstanceData* instances, int startIndex/* = 0*/, int primitiveCount/* = 0*/)
+{
+	SubmitInstanced(renderData, instanceCount, instances, startIndex, primitiveCount);
+}
+
+void RenderContext::SubmitInstanced(RenderData& data, int instanceCount, const InstanceData* instances, int startIndex/* = 0*/, int primitiveCount/* = 0*/)
+{
+	if (instanceCount <= 0) return;
+	assert(instances != nullptr);
+
+	assert(camera != nullptr);
+
+	// uniforms, shader clones and varying buffers are set up once, for the first visible instance
+	bool isPrepared = false;
+	UpdateCameraUniforms();
+	for (int i = 0; i < instanceCount; ++i)
+	{
+		bool needsClipping = true;
+		if (CullBounds(data, UpdateObjectUniforms(instances[i].modelMatrix), needsClipping)) continue;
+
+		if (!isPrepared)
+		{
+			PrepareDraw(data, startIndex, primitiveCount);
+			isPrepared = true;
+		}
+		SetInstance(i, instances[i].userData);
+		DrawInstance(data, startIndex, primitiveCount, needsClipping);
+	}
+}
+
+bool RenderContext::CullBounds(const RenderData& data, const Matrix4x4& matrixMVP, bool& needsClipping)
+{
+	++stats.drawCount;
+	needsClipping = true;
+	if (!shader->isPositionFromMVP) return false;
+
+	// per-vertex clip codes are only needed when the bounds cross a frustum plane
+	Bounds::FrustumTest result = data.GetBounds().TestFrustum(matrixMVP);
+	needsClipping = (result != Bounds::FrustumTest_Inside);
+	if (result != Bounds::FrustumTest_Outside) return false;
+	++stats.boundsCulledDrawCount;
+	return true;
+}
+
+void RenderContext::PrepareDraw(RenderData& data, int startIndex, int primitiveCount)
+{
+	int width = renderTarget->GetWidth();
+	int height = renderTarget->GetHeight();
+
+	// the camera block is already current, Submit needed its VP for culling. The shader reads
+	// the cached blocks in place, its clones below inherit the bindings.
+	UpdateLightUniforms();
+	shader->_Camera = &cameraUniforms.uniforms;
+	shader->_Light = &lightUniforms.uniforms;
+	shader->_Object = &objectUniforms.uniforms;
+
+	// shadow and z-prepass draws only rasterize depth, the pixel shader never runs
+	bool isDepthOnly = (renderState.renderType == RenderState::RenderType_ShadowPrePass);
+
+	rasterizer.Initlize(width, height);
+	hiZBuffer->Sync();
+	// the hiZ test uses interpolated depth, which a depth-writing shader may replace
+	rasterizer.SetHiZBuffer((shader->writesDepth && !isDepthOnly) ? nullptr : hiZBuffer, renderState.zTest);
+	varyingDataBuffer.InitVaryingDataBuffer(shader->varyingDataSize, shader->varyingElements);
+
+	// a guard band of 1 puts the clip planes on the viewport edges
+	int subPixelBits = rasterizer.GetSubPixelBits();
+	float guardBandX = 1.f;
+	float guardBandY = 1.f;
+	if (isGuardBandClipping) Clipper::CalculateGuardBand(width, height, subPixelBits, guardBandX, guardBandY);
+	clipper.SetGuardBand(guardBandX, guardBandY);
+
+	// sort-middle: bin every triangle first, then rasterize whole tiles in parallel.
+	// Depth-only draws never run the pixel shader, so they can tile without shader clones.
+	bool isTiled = (threadPool != nullptr && (shaderCloneFunc != nullptr || isDepthOnly));
+	if (threadPool != nullptr && !isTiled && !hasLoggedSerialShader)
+	{
+		printf("RenderContext: shader set without a clone function, its draws run single-threaded\n");
+		hasLoggedSerialShader = true;
+	}
+	int threadCount = isTiled ? threadPool->GetThreadCount() : 1;
+	threadContexts.resize(threadCount);
+	for (int i = 0; i < threadCount; ++i)
+	{
+		threadContexts[i].shader = shader;
+		threadContexts[i].varyingSlot = 4 * i;
+	}
+	// clones are refreshed after the uniforms above are bound
+	if (shaderCloneFunc != nullptr && threadCount > 1) UpdateShaderClones(threadCount - 1);
+
+	// a sub-range indexing fewer vertices than the buffer holds only pays for what it draws
+	int vertexCount = data.GetVertexCount();
+	if (primitiveCount <= 0) primitiveCount = data.GetPrimitiveCount() - startIndex;
+	bool isLazyVertexShading = (vertexShadingMode == VertexShadingMode_Lazy)
+		|| (vertexShadingMode == VertexShadingMode_Auto && primitiveCount * 3 < vertexCount);
+	if (!isLazyVertexShading) varyingDataBuffer.InitVerticesVaryingData(vertexCount);
+	varyingDataBuffer.InitDynamicVaryingData();
+	varyingDataBuffer.InitPixelVaryingData(4 * threadCount);
+
+	drawSetup.width = width;
+	drawSetup.height = height;
+	drawSetup.subPixelBits = subPixelBits;
+	drawSetup.threadCount = threadCount;
+	drawSetup.isDepthOnly = isDepthOnly;
+	drawSetup.isTiled = isTiled;
+	drawSetup.isLazyVertexShading = isLazyVertexShading;
+}
+
+// Worker threads 1..cloneCount get the shader's clones, kept across draws and copied over
+// from the shader, so a draw refreshes their members without allocating shaders.
+void RenderContext::UpdateShaderClones(int cloneCount)
+{
+	auto found = shaderClones.find(shader.get());
+	if (found == shaderClones.end())
+	{
+		// only a shader without clones sweeps those of released shaders
+		for (auto it = shaderClones.begin(); it != shaderClones.end();)
+		{
+			if (it->second.source.expired()) it = shaderClones.erase(it);
+			else ++it;
+		}
+		found = shaderClones.emplace(shader.get(), ShaderClones()).first;
+	}
+
+	// a released shader's address may have been reused by a shader of another type
+	ShaderClones& entry = found->second;
+	if (entry.source.lock() != shader)
+	{
+		entry.source = shader;
+		entry.clones.clear();
+	}
+	entry.clones.resize(cloneCount);
+	for (int i = 0; i < cloneCount; ++i)
+	{
+		shaderCloneFunc(shader, entry.clones[i]);
+		threadContexts[i + 1].shader = entry.clones[i];
+	}
+}
+
+void RenderContext::UpdateCameraUniforms()
+{
+	int width = renderTarget->GetWidth();
+	int height = renderTarget->GetHeight();
+
+	CameraUniformsCache& cache = cameraUniforms;
+	bool isDirty = (cache.version == 0 || cache.camera != camera.get());
+	cache.camera = camera.get();
+	isDirty |= UpdateInput(cache.transform, camera->transform);
+	isDirty |= UpdateInput(cache.projectionMatrix, camera->projectionMatrix());
+	isDirty |= UpdateInput(cache.zNear, camera->zNear());
+	isDirty |= UpdateInput(cache.zFar, camera->zFar());
+	isDirty |= UpdateInput(cache.width, width);
+	isDirty |= UpdateInput(cache.height, height);
+	if (!isDirty) return;
+
+	CameraUniforms& uniforms = cache.uniforms;
+	uniforms._WorldToCamera = camera->viewMatrix();
+	uniforms._CameraToWorld = camera->transform.localToWorldMatrix();
+
+	uniforms._MATRIX_P = cache.projectionMatrix;
+	uniforms._MATRIX_VP = uniforms._MATRIX_P.Multiply(uniforms._WorldToCamera);
+
+	uniforms._WorldSpaceCameraPos = camera->transform.position;
+	uniforms._ScreenParams = Vector4((float)width, (float)height, 1.f + 1.f / (float)width, 1.f + 1.f / (float)height);
+	uniforms._ZBufferParams = Vector4(cache.zFar, cache.zNear, 0.f, 0.f);
+	++cache.version;
+}
+
+void RenderContext::UpdateLightUniforms()
+{
+	LightUniformsCache& cache = lightUniforms;
+	bool isDirty = (!cache.isValid || cache.light != light.get());
+	cache.light = light.get();
+	if (light != nullptr)
+	{
+		Light& params = cache.params;
+		isDirty |= UpdateInput(params.type, light->type);
+		isDirty |= UpdateInput(params.color, light->color);
+		isDirty |= UpdateInput(params.intensity, light->intensity);
+		isDirty |= UpdateInput(params.transform, light->transform);
+		isDirty |= UpdateInput(params.range, light->range);
+		isDirty |= UpdateInput(params.atten0, light->atten0);
+		isDirty |= UpdateInput(params.atten1, light->atten1);
+		isDirty |= UpdateInput(params.atten2, light->atten2);
+		isDirty |= UpdateInput(params.falloff, light->falloff);
+		isDirty |= UpdateInput(params.theta, light->theta);
+		isDirty |= UpdateInput(params.phi, light->phi);
+	}
+	if (!isDirty) return;
+
+	LightUniforms& uniforms = cache.uniforms;
+	cache.isValid = true;
+	if (light == nullptr)
+	{
+		uniforms._WorldSpaceLightPos = Vector4(0.f, 0.f, 1.f, 0.f);
+		uniforms._LightColor = Color::black;
+		return;
+	}
+
+	light->Initilize();
+	if (light->type == Light::LightType_Directional)
+	{
+		uniforms._WorldSpaceLightPos = Vector4(light->transform.forward(), 0.f);
+	}
+	else
+	{
+		uniforms._WorldSpaceLightPos = Vector4(light->transform.position, 1.f);
+		if (light->type == Light::LightType_Spot)
+		{
+			uniforms._SpotLightDir = Vector3(light->transform.forward());
+			uniforms._SpotLightParams = Vector3(light->cosHalfPhi, light->cosHalfTheta, light->falloff);
+		}
+		else
+		{
+			uniforms._SpotLightParams = Vector3(-1.f, -1.f, 0.f);
+		}
+	}
+	uniforms._LightColor = light->color;
+	uniforms._LightColor *= light->intensity;
+	uniforms._LightAtten = Vector4(light->atten0, light->atten1, light->atten2, light->range);
+}
+
+// Returns the object's MVP for culling; MV and the inverse wait for SetInstance.
+// Needs the camera block to be current.
+const Matrix4x4& RenderContext::UpdateObjectUniforms(const Matrix4x4& objectMatrix)
+{
+	ObjectUniformsCache& cache = objectUniforms;
+	bool isObjectDirty = UpdateInput(cache.objectMatrix, objectMatrix);
+	if (!isObjectDirty && cache.isValid && cache.cameraVersion == cameraUniforms.version)
+	{
+		return cache.uniforms._MATRIX_MVP;
+	}
+
+	ObjectUniforms& uniforms = cache.uniforms;
+	uniforms._Object2World = objectMatrix;
+	uniforms._MATRIX_MVP = cameraUniforms.uniforms._MATRIX_VP.Multiply(objectMatrix);
+	cache.isValid = true;
+	cache.cameraVersion = cameraUniforms.version;
+	cache.isMVDirty = true;
+	cache.isInverseDirty |= isObjectDirty;
+	return uniforms._MATRIX_MVP;
+}
+
+void RenderContext::SetInstance(int instanceID, rawptr_t instanceData)
+{
+	ObjectUniformsCache& cache = objectUniforms;
+	ObjectUniforms& uniforms = cache.uniforms;
+	if (cache.isMVDirty)
+	{
+		uniforms._MATRIX_MV = cameraUniforms.uniforms._WorldToCamera.Multiply(uniforms._Object2World);
+		cache.isMVDirty = false;
+	}
+	if (cache.isInverseDirty)
+	{
+		uniforms._World2Object = uniforms._Object2World.Inverse();
+		cache.isInverseDirty = false;
+	}
+
+	// the shader and its clones all see the current instance, in the vertex and the pixel stage;
+	// the object block they point at was updated above
+	for (int i = 0; i < drawSetup.threadCount; ++i)
+	{
+		ShaderPtr& threadShader = threadContexts[i].shader;
+		threadShader->SV_InstanceID = instanceID;
+		threadShader->instanceData = instanceData;
+	}
+}
+
+void RenderContext::DrawInstance(RenderData& data, int startIndex, int primitiveCount, bool needsClipping)
+{
+	int width = drawSetup.width;
+	int height = drawSetup.height;
+	int subPixelBits = drawSetup.subPixelBits;
+	int threadCount = drawSetup.threadCount;
+	bool isDepthOnly = drawSetup.isDepthOnly;
+	bool isTiled = drawSetup.isTiled;
+	bool isLazyVertexShading = drawSetup.isLazyVertexShading;
+
+	if (isLazyVertexShading)
+	{
+		// vertices are shaded serially during primitive assembly, the first time they are indexed
+		varyingDataBuffer.ResetVertexCache(data.GetVertexCount());
+	}
+	else
+	{
+		// every vertex writes only its own varying slot, so chunks can be shaded on any thread
+		int vertexCount = data.GetVertexCount();
+		int vertexChunkCount = (vertexCount + VERTEX_CHUNK_SIZE - 1) / VERTEX_CHUNK_SIZE;
+		auto shadeVertices = [this, &data, vertexCount, needsClipping](int chunkIndex, int threadIndex)
+		{
+			ShaderPtr& vertexShader = threadContexts[threadIndex].shader;
+			int endIndex = Mathf::Min((chunkIndex + 1) * VERTEX_CHUNK_SIZE, vertexCount);
+			for (int i = chunkIndex * VERTEX_CHUNK_SIZE; i < endIndex; ++i)
+			{
+				ShadeVertex(vertexShader, data, i, varyingDataBuffer.GetVertexVaryingData(i), needsClipping);
+			}
+		};
+		if (threadPool != nullptr && shaderCloneFunc != nullptr && threadCount > 1)
+		{
+			threadPool->ParallelFor(vertexChunkCount, shadeVertices);
+		}
+		else
+		{
+			for (int i = 0; i < vertexChunkCount; ++i) shadeVertices(i, 0);
+		}
+	}
+	auto fetchVertex = [this, &data, isLazyVertexShading, needsClipping](int index) -> const VertexVaryingData&
+	{
+		if (!isLazyVertexShading) return varyingDataBuffer.GetVertexVaryingData(index);
+
+		VertexVaryingData* varyingData = varyingDataBuffer.FindCachedVertex(index);
+		if (varyingData != nullptr) return *varyingData;
+		VertexVaryingData& newVaryingData = varyingDataBuffer.AddCachedVertex(index);
+		ShadeVertex(threadContexts[0].shader, data, index, newVaryingData, needsClipping);
+		return newVaryingData;
+	};
+
+	if (isTiled)
+	{
+		tileCountX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tileCountY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		tileBins.resize(tileCountX * tileCountY);
+		for (auto& bin : tileBins) bin.clear();
+		binnedTriangles.clear();
+		attributePlanes.clear();
+	}
+	const VaryingLayout& varyingLayout = varyingDataBuffer.GetVaryingLayout();
+
+	auto depthFunc = [this](const Rasterizer2x2Info& quad) { Rasterizer2x2DepthFunc(quad); };
+	ClipPolygon<VertexVaryingData> polygon;
+	Projection polygonProjection[ClipPolygon<VertexVaryingData>::MAX_VERTEX_COUNT];
+	if (primitiveCount <= 0) primitiveCount = data.GetPrimitiveCount() - startIndex;
+	for (int i = 0; i < primitiveCount; ++i)
+	{
+		int primitiveIndex = i + startIndex;
+		Triangle<uint32_t> triangleIdx;
+		if (!data.GetTrianglePrimitive(primitiveIndex, triangleIdx))
+		{
+			assert(false);
+			continue;
+		}
+
+		// copies: lazily added vertices may move the cache entries of earlier ones
+		VertexVaryingData v0 = fetchVertex(triangleIdx.v0);
+		VertexVaryingData v1 = fetchVertex(triangleIdx.v1);
+		VertexVaryingData v2 = fetchVertex(triangleIdx.v2);
+
+		// cull before clipping, so back faces never pay for clipping or interpolation
+		++stats.primitiveCount;
+		if (renderState.FaceCulling(v0.position, v1.position, v2.position))
+		{
+			++stats.backFaceCulledCount;
+			continue;
+		}
+
+		// clipped vertices live only until their planes are set up
+		varyingDataBuffer.ResetDynamicVaryingData();
+		int triangleCount = clipper.ClipTriangle(v0, v1, v2, polygon);
+		if (triangleCount == 0) ++stats.clippedAwayCount;
+		for (int j = 0; j < polygon.vertexCount; ++j)
+		{
+			polygonProjection[j] = Projection::CalculateViewProjection(polygon.vertices[j].position, width, height, subPixelBits);
+		}
+		for (int j = 0; j < triangleCount; ++j)
+		{
+			Triangle<VertexVaryingData> triangle = polygon.GetTriangle(j);
+			Triangle<Projection> projection(polygonProjection[0], polygonProjection[j + 1], polygonProjection[j + 2]);
+			if (rasterizer.IsTriangleCulled(projection) || renderState.FaceCullingSimple(projection, triangle))
+			{
+				++stats.rasterCulledCount;
+				continue;
+			}
+			++stats.rasterizedCount;
+
+			if (camera->projectionMode() == Camera::ProjectionMode_Perspective)
+			{
+				projection.v0.z = camera->GetLinearDepth(projection.v0.z);
+				projection.v1.z = camera->GetLinearDepth(projection.v1.z);
+				projection.v2.z = camera->GetLinearDepth(projection.v2.z);
+			}
+
+			// varyings are interpolated from planes set up once per triangle, tiles keep them until the end of the draw
+			int planeOffset = isTiled ? (int)attributePlanes.size() : 0;
+			if (!isDepthOnly)
+			{
+				attributePlanes.resize(planeOffset + varyingLayout.floatCount * 3);
+				PlaneSetup planeSetup(projection.v0, projection.v1, projection.v2, subPixelBits);
+				VertexVaryingData::CalculatePlanes(&attributePlanes[planeOffset], varyingLayout, planeSetup, triangle, projection);
+			}
+
+			if (isTiled)
+			{
+				BinTriangle(projection, planeOffset);
+				continue;
+			}
+
+			if (isDepthOnly)
+			{
+				rasterizer.RasterizerTriangle(projection, depthFunc);
+				continue;
+			}
+
+			ThreadContext& context = threadContexts[0];
+			const float* planes = &attributePlanes[0];
+			auto renderFunc = [this, &context, planes](const Rasterizer2x2Info& quad)
+			{
+				Rasterizer2x2RenderFunc(context, planes, quad);
+			};
+			rasterizer.RasterizerTriangle(projection, renderFunc);
+		}
+
+
+		/* // draw wireframe
+		std::vector<Line<VertexVaryingData> > lines;
+		auto l1 = clipper.ClipLine(v0, v1);
+		lines.insert(lines.end(), l1.begin(), l1.end());
+		auto l2 = clipper.ClipLine(v0, v2);
+		lines.insert(lines.end(), l2.begin(), l2.end());
+		auto l3 = clipper.ClipLine(v1, v2);
+		lines.insert(lines.end(), l3.begin(), l3.end());
+
+		for (auto& line : lines)
+		{
+			Projection p0 = Projection::CalculateViewProjection(line.v0.position, width, height);
+			Projection p1 = Projection::CalculateViewProjection(line.v1.position, width, height);
+			rasterizer.DrawLine(p0.x, p1.x, p0.y, p1.y, Color::blue);
+		}
+		*/
+	}
+
+	if (isTiled) RasterizeTiles();
+
+	/* draw point
+	for (int i = 0; i < vertexCount; ++i)
+	{
+		auto data = varyingDataBuffer.GetVertexVaryingData(i);
+		if (data.clipCode != 0) continue;
+
+		Projection proj = Projection::CalculateViewProjection(data.position, width, height);
+		canvas->SetPixel(proj.x, proj.y, Color::red);
+	}
+	*/
+}
+
+void RenderContext::ShadeVertex(ShaderPtr& vertexShader, RenderData& data, int index, VertexVaryingData& varyingData, bool needsClipping)
+{
+	vertexShader->varyingData = varyingData.data;
+	rawptr_t vertexData = data.GetVertexData<uint8_t>(index);
+	vertexShader->_VSMain(vertexData);
+
+	varyingData.position = *Buffer::Value<Vector4>(vertexShader->varyingData, 0);
+	// a zero clip code lets the clipper pass every triangle straight through
+	varyingData.clipCode = needsClipping ? clipper.CalculateClipCode(varyingData.position) : 0;
+}
+
+void RenderContext::BinTriangle(const Triangle<Projection>& projection, int planeOffset)
+{
+	int minX, minY, maxX, maxY;
+	if (!rasterizer.CalculateBoundingBox(projection, minX, minY, maxX, maxY)) return;
+
+	int index = (int)binnedTriangles.size();
+	binnedTriangles.push_back(BinnedTriangle { projection, planeOffset });
+
+	// quads are aligned to the bounding box, so a quad may spill one pixel into the next tile
+	for (int ty = minY / TILE_SIZE; ty <= maxY / TILE_SIZE; ++ty)
+	{
+		for (int tx = minX / TILE_SIZE; tx <= maxX / TILE_SIZE; ++tx)
+		{
+			tileBins[ty * tileCountX + tx].push_back(index);
+		}
+	}
+}
+
+void RenderContext::RasterizeTiles()
+{
+	int width = renderTarget->GetWidth();
+	int height = renderTarget->GetHeight();
+	bool isDepthOnly = (renderState.renderType == RenderState::RenderType_ShadowPrePass);
+
+	threadPool->ParallelFor(tileCountX * tileCountY, [this, width, height, isDepthOnly](int tileIndex, int threadIndex)
+	{
+		const auto& bin = tileBins[tileIndex];
+		if (bin.empty()) return;
+
+		int minX = (tileIndex % tileCountX) * TILE_SIZE;
+		int minY = (tileIndex / tileCountX) * TILE_SIZE;
+		int maxX = Mathf::Min(minX + TILE_SIZE, width) - 1;
+		int maxY = Mathf::Min(minY + TILE_SIZE, height) - 1;
+
+		ThreadContext& context = threadContexts[threadIndex];
+		auto depthFunc = [this](const Rasterizer2x2Info& quad) { Rasterizer2x2DepthFunc(quad); };
+
+		// triangles were binned in submission order, which keeps blending and depth results stable
+		for (int index : bin)
+		{
+			const BinnedTriangle& binned = binnedTriangles[index];
+			if (isDepthOnly)
+			{
+				rasterizer.RasterizerTriangle(binned.projection, depthFunc, minX, minY, maxX, maxY);
+				continue;
+			}
+
+			const float* planes = &attributePlanes[binned.planeOffset];
+			auto renderFunc = [this, &context, planes](const Rasterizer2x2Info& quad)
+			{
+				Rasterizer2x2RenderFunc(context, planes, quad);
+			};
+			rasterizer.RasterizerTriangle(binned.projection, renderFunc, minX, minY, maxX, maxY);
+		}
+	});
+}
+
+void RenderContext::SetShader(ShaderPtr shader)
+{
+	// the concrete type is unknown here, so tiles fall back to the serial path
+	SetShader(shader, nullptr);
+}
+
+void RenderContext::SetShader(ShaderPtr shader, const ShaderCloneFunc& cloneFunc)
+{
+	assert(shader != nullptr);
+	this->shader = shader;
+	shaderCloneFunc = cloneFunc;
+}
+
+void RenderContext::RasterizerRenderFunc(const VertexVaryingData& data, const RasterizerInfo& info)
+{
+	int x = info.x;
+	int y = info.y;
+
+	float depthInBuffer = depthBuffer->GetAlpha(x, y);
+	if (!renderState.ZTest(info.depth, depthInBuffer)) return;
+
+	if (renderState.stencilOn) 
+	{
+		uint8_t stencilContent = stencilBuffer->GetStencil(x, y);
+		if (!renderState.StencilTest(stencilContent)) return;
+		stencilBuffer->SetStencil(x, y, renderState.WriteStencil(stencilContent));
+	}
+
+	shader->varyingData = data.data;
+	shader->isClipped = false;
+	shader->SV_Target0 = Color::clear;
+	shader->SV_Target1 = Color::clear;
+	shader->SV_Target2 = Color::clear;
+	shader->SV_Target3 = Color::clear;
+	shader->_PSMain();
+	if (!shader->isClipped)
+	{
+		if (renderState.alphaBlend)
+		{
+			auto buffer = renderTarget->GetColorBuffer();
+			buffer->SetPixel(x, y, renderState.Blend(shader->SV_Target0, buffer->GetPixel(x, y)));
+
+			for (int k = 0; k < 3; ++k)
+			{
+				buffer = renderTarget->GetGBuffer(k);
+				if (buffer)
+				{
+					buffer->SetPixel(x, y, renderState.Blend(ShaderGBufferOutput(shader, k), buffer->GetPixel(x, y)));
+				}
+			}
+		}
+		else
+		{
+			auto buffer = renderTarget->GetColorBuffer();
+			buffer->SetPixel(x, y, shader->SV_Target0);
+
+			for (int k = 0; k < 3; ++k)
+			{
+				buffer = renderTarget->GetGBuffer(k);
+				if (buffer)
+				{
+					buffer->SetPixel(x, y, ShaderGBufferOutput(shader, k));
+				}
+			}
+		}
+		if (renderState.zWrite)
+		{
+			hiZBuffer->WriteDepth(x, y, depthInBuffer, info.depth);
+		}
+	}
+}
+
+void RenderContext::Rasterizer2x2RenderFunc(ThreadContext& context, const float* planes, const Rasterizer2x2Info& quad)
+{
+	static int quadX[4] = { 0, 1, 0, 1 };
+	static int quadY[4] = { 0, 0, 1, 1 };
+
+	ShaderPtr& shader = context.shader;
+
+	// Early-z tests the whole quad before anything is interpolated. Shaders that output depth
+	// are tested after _PSMain, shaders that clip are tested early but write after _PSMain.
+	// A shader that calls Clip without declaring hasClip gets it set by Clip.
+	bool isEarlyDepthTest = !shader->writesDepth;
+	bool isEarlyDepthWrite = isEarlyDepthTest && !shader->hasClip;
+
+	uint8_t maskCode = quad.maskCode;
+	float depthInBuffer[4];
+	uint8_t stencilInBuffer[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		if (!(maskCode & (1 << i))) continue;
+
+		int x = quad.x + quadX[i];
+		int y = quad.y + quadY[i];
+
+		depthInBuffer[i] = depthBuffer->GetAlpha(x, y);
+		if (!isEarlyDepthTest) continue;
+		if (!DepthStencilTest(x, y, quad.depth[i], depthInBuffer[i]))
+		{
+			maskCode &= ~(1 << i);
+			continue;
+		}
+		if (isEarlyDepthWrite)
+		{
+			if (renderState.stencilOn) stencilInBuffer[i] = stencilBuffer->GetStencil(x, y);
+			DepthStencilWrite(x, y, quad.depth[i], depthInBuffer[i]);
+		}
+	}
+	if (maskCode == 0) return;
+
+	rawptr_t pixelVaryingDataQuad[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		pixelVaryingDataQuad[i] = varyingDataBuffer.GetPixelVaryingData(context.varyingSlot + i).data;
+	}
+	const VaryingLayout& layout = varyingDataBuffer.GetVaryingLayout();
+	switch (rasterizer.GetSIMDLevel())
+	{
+#if _SIMD_X86_
+	case Rasterizer::SIMDLevel_AVX2:
+		VertexVaryingData::PlaneInterpValueAVX2(pixelVaryingDataQuad, planes, layout, quad.planeX, quad.planeY, quad.w);
+		break;
+	case Rasterizer::SIMDLevel_SSE41:
+		VertexVaryingData::PlaneInterpValueSSE41(pixelVaryingDataQuad, planes, layout, quad.planeX, quad.planeY, quad.w);
+		break;
+#endif
+	default:
+		VertexVaryingData::PlaneInterpValue(pixelVaryingDataQuad, planes, layout, quad.planeX, quad.planeY, quad.w);
+		break;
+	}
+	shader->_PassQuad(pixelVaryingDataQuad);
+
+	PixelQuadOutput output;
+	for (int i = 0; i < 4; ++i) output.SV_Depth[i] = quad.depth[i];
+	shader->_PSQuad(pixelVaryingDataQuad, maskCode, output);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		if (!(maskCode & (1 << i))) continue;
+
+		int x = quad.x + quadX[i];
+		int y = quad.y + quadY[i];
+
+		if (output.clipMask & (1 << i))
+		{
+			// first Clip of an undeclared shader, take back this quad's early writes
+			if (isEarlyDepthWrite)
+			{
+				if (renderState.stencilOn) stencilBuffer->SetStencil(x, y, stencilInBuffer[i]);
+				if (renderState.zWrite) hiZBuffer->WriteDepth(x, y, quad.depth[i], depthInBuffer[i]);
+			}
+			continue;
+		}
+
+		if (!isEarlyDepthWrite)
+		{
+			float depth = shader->writesDepth ? output.SV_Depth[i] : quad.depth[i];
+			if (!isEarlyDepthTest && !DepthStencilTest(x, y, depth, depthInBuffer[i])) continue;
+			DepthStencilWrite(x, y, depth, depthInBuffer[i]);
+		}
+
+		if (renderState.alphaBlend)
+		{
+			auto buffer = renderTarget->GetColorBuffer();
+			buffer->SetPixel(x, y, renderState.Blend(output.SV_Target0[i], buffer->GetPixel(x, y)));
+
+			for (int k = 0; k < 3; ++k)
+			{
+				buffer = renderTarget->GetGBuffer(k);
+				if (buffer)
+				{
+					buffer->SetPixel(x, y, renderState.Blend(ShaderGBufferOutput(output, k, i), buffer->GetPixel(x, y)));
+				}
+			}
+		}
+		else
+		{
+			auto buffer = renderTarget->GetColorBuffer();
+			buffer->SetPixel(x, y, output.SV_Target0[i]);
+
+			for (int k = 0; k < 3; ++k)
+			{
+				buffer = renderTarget->GetGBuffer(k);
+				if (buffer)
+				{
+					buffer->SetPixel(x, y, ShaderGBufferOutput(output, k, i));
+				}
+			}
+		}
+	}
+}
+
+void RenderContext::Rasterizer2x2DepthFunc(const Rasterizer2x2Info& quad)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		if (!(quad.maskCode & (1 << i))) continue;
+
+		int x = quad.x + (i & 1);
+		int y = quad.y + (i >> 1);
+
+		float depthInBuffer = depthBuffer->GetAlpha(x, y);
+		if (!DepthStencilTest(x, y, quad.depth[i], depthInBuffer)) continue;
+		DepthStencilWrite(x, y, quad.depth[i], depthInBuffer);
+	}
+}
+
+bool RenderContext::DepthStencilTest(int x, int y, float depth, float depthInBuffer)
+{
+	if (!renderState.ZTest(depth, depthInBuffer)) return false;
+	if (renderState.stencilOn && !renderState.StencilTest(stencilBuffer->GetStencil(x, y))) return false;
+	return true;
+}
+
+void RenderContext::DepthStencilWrite(int x, int y, float depth, float depthInBuffer)
+{
+	if (renderState.stencilOn)
+	{
+		stencilBuffer->SetStencil(x, y, renderState.WriteStencil(stencilBuffer->GetStencil(x, y)));
+	}
+	if (renderState.zWrite)
+	{
+		hiZBuffer->WriteDepth(x, y, depthInBuffer, depth);
+	}
+}
+
+const Color& RenderContext::ShaderGBufferOutput(ShaderPtr& shader, int index)
+{
+	switch (index)
+	{
+	case 0:
+		return shader->SV_Target1;
+	case 1:
+		return shader->SV_Target2;
+	case 2:
+		return shader->SV_Target3;
+	default:
+		throw std::out_of_range("g-buffer index out of range!");
+	}
+}
+
+const Color& RenderContext::ShaderGBufferOutput(const PixelQuadOutput& output, int index, int pixel)
+{
+	switch (index)
+	{
+	case 0:
+		return output.SV_Target1[pixel];
+	case 1:
+		return output.SV_Target2[pixel];
+	case 2:
+		return output.SV_Target3[pixel];
+	default:
+		throw std::out_of_range("g-buffer index out of range!");
+	}
+}
+
+void RenderContext::Clear(bool clearColor, bool clearDepth, const Color& backgroundColor, float depth /*= 1.0f*/)
+{
+	if (clearColor) colorBuffer->Fill(backgroundColor);
+	if (clearDepth)
+	{
+		depthBuffer->Fill(Color(depth, 0.f, 0.f, 0.f));
+		hiZBuffer->Reset(depth);
+	}
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,251 @@
+#ifndef _SOFTRENDER_RENDER_CONTEXT_H_
+#define _SOFTRENDER_RENDER_CONTEXT_H_
+
+#include "base/header.h"
+#include "base/thread_pool.h"
+#include "math/matrix4x4.h"
+#include "softrender/camera.h"
+#include "softrender/light.hpp"
+#include "softrender/texture2d.h"
+#include "softrender/cubemap.h"
+#include "softrender/stencil.hpp"
+#include "softrender/render_texture.h"
+#include "softrender/render_state.hpp"
+#include "softrender/render_data.hpp"
+#include "softrender/varying_data.h"
+#include "softrender/clipper.hpp"
+#include "softrender/srtypes.hpp"
+#include "softrender/shader.hpp"
+#include "softrender/rasterizer.hpp"
+
+namespace sr
+{
+
+class RenderContext;
+typedef std::shared_ptr<RenderContext> RenderContextPtr;
+
+// per-instance attributes of SubmitInstanced, seen by the shader as the object matrices,
+// SV_InstanceID and instanceData
+struct InstanceData
+{
+	Matrix4x4 modelMatrix;
+	rawptr_t userData = nullptr;
+};
+
+// Owns the whole pipeline state of one view. Contexts share nothing, so independent
+// contexts can render concurrently, one per thread. Texture2D::Initialize must have been
+// called once per process before any context loads or samples textures.
+class RenderContext
+{
+public:
+	RenderState renderState;
+	RenderData renderData;
+
+	Matrix4x4 modelMatrix;
+	CameraPtr camera = nullptr;
+	LightPtr light = nullptr;
+
+	RenderContext() = default;
+	RenderContext(const RenderContext&) = delete;
+	RenderContext& operator=(const RenderContext&) = delete;
+
+	void Initialize(int width, int height);
+	void SetRenderTarget(RenderTexturePtr target);
+	RenderTexturePtr GetRenderTarget();
+	void ClearStencilBuffer(uint8_t stencil);
+	StencilBufferPtr GetStencilBuffer();
+	// copies source into clone, allocating clone when it is nullptr
+	typedef std::function<void(const ShaderPtr& source, ShaderPtr& clone)> ShaderCloneFunc;
+	template<typename ShaderType>
+	static ShaderCloneFunc GetShaderCloneFunc()
+	{
+		return [](const ShaderPtr& source, ShaderPtr& clone)
+		{
+			const ShaderType& typedSource = *std::static_pointer_cast<ShaderType>(source);
+			if (clone == nullptr) clone = std::make_shared<ShaderType>(typedSource);
+			else *std::static_pointer_cast<ShaderType>(clone) = typedSource;
+		};
+	}
+
+	// The concrete type is unknown, so the shader can't be cloned for worker threads: its draws
+	// run single-threaded even with SetThreadCount > 1 (logged once). Prefer the typed overload.
+	void SetShader(ShaderPtr shader);
+	// cloneFunc copies the shader for worker threads, nullptr keeps the draw single-threaded
+	void SetShader(ShaderPtr shader, const ShaderCloneFunc& cloneFunc);
+	template<typename ShaderType>
+	void SetShader(std::shared_ptr<ShaderType> shader)
+	{
+		SetShader(std::static_pointer_cast<IShader>(shader), GetShaderCloneFunc<ShaderType>());
+	}
+	ShaderPtr GetShader() const { return shader; }
+	// the clone function the current shader was set with, nullptr if it has none
+	const ShaderCloneFunc& GetCurrentShaderCloneFunc() const { return shaderCloneFunc; }
+	// threadCount > 1 bins triangles into tiles and rasterizes the tiles in parallel
+	void SetThreadCount(int threadCount);
+	int GetThreadCount() const;
+	// fractional bits of the screen-space vertex grid, 4 by default, at most 8
+	void SetSubPixelBits(int bits);
+	// on by default: only near/far and the guard band split triangles, not the viewport edges
+	void SetGuardBandClipping(bool enable);
+
+	enum VertexShadingMode
+	{
+		// every vertex of the buffer up front, in parallel chunks
+		VertexShadingMode_Eager,
+		// only vertices the drawn primitives index, on first use through a post-transform cache
+		VertexShadingMode_Lazy,
+		// lazy for ranges that index fewer vertices than the buffer holds
+		VertexShadingMode_Auto,
+	};
+	void SetVertexShadingMode(VertexShadingMode mode);
+
+	// counters since the last ResetStats; draws count instances, the raster counts are of clipped triangles
+	struct Stats
+	{
+		int drawCount = 0;
+		int boundsCulledDrawCount = 0;
+		int primitiveCount = 0;
+		int backFaceCulledCount = 0;
+		int clippedAwayCount = 0;
+		// off screen, zero area after snapping, or facing away once snapped
+		int rasterCulledCount = 0;
+		int rasterizedCount = 0;
+	};
+	const Stats& GetStats() const { return stats; }
+	void ResetStats() { stats = Stats(); }
+
+	void Clear(bool clearColor, bool clearDepth, const Color& backgroundColor, float depth = 1.0f);
+	void Submit(int startIndex = 0, int primitiveCount = 0);
+	// draws data instead of the context's own renderData
+	void Submit(RenderData& data, int startIndex = 0, int primitiveCount = 0);
+	// draws the same primitives once per instance, paying the per-draw setup once
+	void SubmitInstanced(int instanceCount, const InstanceData* instances, int startIndex = 0, int primitiveCount = 0);
+	void SubmitInstanced(RenderData& data, int instanceCount, const InstanceData* instances, int startIndex = 0, int primitiveCount = 0);
+
+	static const int TILE_SIZE = 64;
+	// vertices shaded per thread pool task
+	static const int VERTEX_CHUNK_SIZE = 256;
+
+private:
+	// per-thread shader copy and pixel varying slots, used by vertex shading and tiles
+	struct ThreadContext
+	{
+		ShaderPtr shader;
+		int varyingSlot = 0;
+	};
+
+	// per-draw values shared by all instances of a draw
+	struct DrawSetup
+	{
+		int width = 0;
+		int height = 0;
+		int subPixelBits = 0;
+		int threadCount = 1;
+		bool isDepthOnly = false;
+		bool isTiled = false;
+		bool isLazyVertexShading = false;
+	};
+
+	struct BinnedTriangle
+	{
+		Triangle<Projection> projection;
+		// first of the triangle's planes in attributePlanes
+		int planeOffset;
+	};
+
+	// the worker-thread copies of a shader
+	struct ShaderClones
+	{
+		std::weak_ptr<IShader> source;
+		std::vector<ShaderPtr> clones;
+	};
+
+	// uniform blocks with the inputs they were computed from, a block changes only when an input does
+	struct CameraUniformsCache
+	{
+		CameraUniforms uniforms;
+		// bumped on every change, 0 before the first
+		uint64_t version = 0;
+		const Camera* camera = nullptr;
+		Transform transform;
+		Matrix4x4 projectionMatrix;
+		float zNear = 0.f;
+		float zFar = 0.f;
+		int width = 0;
+		int height = 0;
+	};
+
+	struct LightUniformsCache
+	{
+		LightUniforms uniforms;
+		bool isValid = false;
+		const Light* light = nullptr;
+		Light params;
+	};
+
+	struct ObjectUniformsCache
+	{
+		ObjectUniforms uniforms;
+		bool isValid = false;
+		Matrix4x4 objectMatrix;
+		// the camera block the MVP was computed from
+		uint64_t cameraVersion = 0;
+		// MV and the inverse are only needed once an instance survives culling
+		bool isMVDirty = true;
+		bool isInverseDirty = true;
+	};
+
+	bool CullBounds(const RenderData& data, const Matrix4x4& matrixMVP, bool& needsClipping);
+	void UpdateCameraUniforms();
+	void UpdateLightUniforms();
+	const Matrix4x4& UpdateObjectUniforms(const Matrix4x4& objectMatrix);
+	void PrepareDraw(RenderData& data, int startIndex, int primitiveCount);
+	void UpdateShaderClones(int cloneCount);
+	void SetInstance(int instanceID, rawptr_t instanceData);
+	void DrawInstance(RenderData& data, int startIndex, int primitiveCount, bool needsClipping);
+	void ShadeVertex(ShaderPtr& vertexShader, RenderData& data, int index, VertexVaryingData& varyingData, bool needsClipping);
+	void RasterizerRenderFunc(const VertexVaryingData& data, const RasterizerInfo& info);
+	void Rasterizer2x2RenderFunc(ThreadContext& context, const float* planes, const Rasterizer2x2Info& info);
+	void Rasterizer2x2DepthFunc(const Rasterizer2x2Info& info);
+	bool DepthStencilTest(int x, int y, float depth, float depthInBuffer);
+	void DepthStencilWrite(int x, int y, float depth, float depthInBuffer);
+	static const Color& ShaderGBufferOutput(ShaderPtr& shader, int index);
+	static const Color& ShaderGBufferOutput(const PixelQuadOutput& output, int index, int pixel);
+	void BinTriangle(const Triangle<Projection>& projection, int planeOffset);
+	void RasterizeTiles();
+
+	VaryingDataBuffer varyingDataBuffer;
+	ShaderPtr shader = nullptr;
+	ShaderCloneFunc shaderCloneFunc = nullptr;
+	std::map<const IShader*, ShaderClones> shaderClones;
+
+	DrawSetup drawSetup;
+	CameraUniformsCache cameraUniforms;
+	LightUniformsCache lightUniforms;
+	ObjectUniformsCache objectUniforms;
+	ThreadPoolPtr threadPool = nullptr;
+	std::vector<ThreadContext> threadContexts;
+	std::vector<BinnedTriangle> binnedTriangles;
+	std::vector<float> attributePlanes;
+	std::vector<std::vector<int> > tileBins;
+	int tileCountX = 0;
+	int tileCountY = 0;
+	bool isGuardBandClipping = true;
+	bool hasLoggedSerialShader = false;
+	VertexShadingMode vertexShadingMode = VertexShadingMode_Auto;
+	Stats stats;
+
+	RenderTexturePtr defaultRenderTarget = nullptr;
+	RenderTexturePtr renderTarget = nullptr;
+	BitmapPtr colorBuffer = nullptr;
+	BitmapPtr depthBuffer = nullptr;
+	HiZBufferPtr hiZBuffer = nullptr;
+	StencilBufferPtr stencilBuffer = nullptr;
+
+	Rasterizer rasterizer;
+	Clipper clipper;
+};
+
+}
+
+#endif //! _SOFTRENDER_RENDER_CONTEXT_H_
@@ -7,158 +7,114 @@
 #include "math/vector4.h"
 #include "math/matrix4x4.h"
 #include "softrender/srtypes.hpp"
-#include "softrender/buffer.h"
 #include "softrender/mesh.h"
+#include "softrender/vertex_buffer.h"
+#include "softrender/index_buffer.h"
 
 namespace sr
 {
 
+class RenderData;
+typedef std::shared_ptr<RenderData> RenderDataPtr;
+
 class RenderData
 {
 public:
+	// builds new buffers from the mesh on every call, bind buffers created once where possible
 	template<typename VertexType>
 	bool AssetVerticesIndicesBuffer(const Mesh& mesh)
 	{
-		uint32_t vertexTypeSize = sizeof(VertexType);
-		auto& elements = VertexType::elements();
-		uint32_t vertexElementsSize = 0;
-		for (auto element : elements)
-		{
-			switch (element)
-			{
-			case Mesh::VertexElement_Position:
-				vertexElementsSize += sizeof(Vector3);
-				break;
-			case Mesh::VertexElement_Normal:
-				vertexElementsSize += sizeof(Vector3);
-				assert (mesh.normals.size() == mesh.vertices.size());
-				break;
-			case Mesh::VertexElement_Tangent:
-				vertexElementsSize += sizeof(Vector4);
-				assert(mesh.tangents.size() == mesh.vertices.size());
-				break;
-			case Mesh::VertexElement_Color:
-				vertexElementsSize += sizeof(Color);
-				assert(mesh.colors.size() == mesh.vertices.size());
-				break;
-			case Mesh::VertexElement_Texcoord:
-				vertexElementsSize += sizeof(Vector2);
-				assert(mesh.texcoords.size() == mesh.vertices.size());
-				break;
-			default:
-				break;
-			}
-		}
-		assert(vertexElementsSize == vertexTypeSize);
-		if (vertexElementsSize != vertexTypeSize)
-		{
-			return false;
-		}
-
-		std::vector<VertexType> vertexBuffer;
-		for (uint32_t i = 0; i < mesh.vertices.size(); ++i)
-		{
-			VertexType v;
-			rawptr_t p = (rawptr_t)&v;
-			for (Mesh::VertexElement element : elements)
-			{
-				switch (element)
-				{
-				case Mesh::VertexElement_Position:
-					*(Vector3*)p = mesh.vertices[i];
-					p += sizeof(Vector3);
-					break;
-				case Mesh::VertexElement_Normal:
-					*(Vector3*)p = mesh.normals[i];
-					p += sizeof(Vector3);
-					break;
-				case Mesh::VertexElement_Tangent:
-					*(Vector4*)p = mesh.tangents[i];
-					p += sizeof(Vector4);
-					break;
-				case Mesh::VertexElement_Color:
-					*(Color*)p = mesh.colors[i];
-					p += sizeof(Color);
-					break;
-				case Mesh::VertexElement_Texcoord:
-					*(Vector2*)p = mesh.texcoords[i];
-					p += sizeof(Vector2);
-					break;
-				default:
-					break;
-				}
-			}
-			vertexBuffer.push_back(v);
-		}
-		if (!AssignVertexBuffer(vertexBuffer))
-		{
-			return false;
-		}
-		AssignIndexBuffer(mesh.indices);
+		VertexBufferPtr newVertexBuffer = VertexBuffer::Create<VertexType>(mesh);
+		if (newVertexBuffer == nullptr) return false;
+		SetVertexBuffer(newVertexBuffer);
+		SetIndexBuffer(IndexBuffer::Create(mesh.indices));
 		return true;
 	}
 
 	template<typename VertexType>
 	bool AssignVertexBuffer(const std::vector<VertexType>& vertices)
 	{
-		static const int VERTEX_MAX_COUNT = (1 << 16) - 1;
-		int count = (int)vertices.size();
-		assert(count <= VERTEX_MAX_COUNT);
-		if (count > VERTEX_MAX_COUNT) return false;
-		vertexBuffer.Assign(vertices);
-		vertexCount = count;
-		vertexSize = sizeof(VertexType);
+		// the position layout is unknown here, draws are not culled until SetBounds
+		SetVertexBuffer(VertexBuffer::Create(vertices));
 		return true;
 	}
 
-	int GetVertexCount()
+	bool AssignIndexBuffer(const std::vector<uint16_t>& indices)
 	{
-		return vertexCount;
+		SetIndexBuffer(IndexBuffer::Create(indices));
+		return true;
 	}
 
-	template<typename VertexType = void>
-	VertexType* GetVertexData(int index)
+	bool AssignIndexBuffer(const std::vector<uint32_t>& indices)
 	{
-		return (VertexType*)vertexBuffer[index];
+		SetIndexBuffer(IndexBuffer::Create(indices));
+		return true;
 	}
 
-	bool AssignIndexBuffer(const std::vector<uint16_t>& indices)
+	// binding shares the buffer, nothing is copied
+	void SetVertexBuffer(VertexBufferPtr vertexBuffer)
 	{
-		int count = (int)indices.size();
-		indexBuffer.Assign(indices);
-		indexCount = count;
-		return true;
+		this->vertexBuffer = vertexBuffer;
+		bounds = (vertexBuffer != nullptr) ? vertexBuffer->GetBounds() : Bounds();
 	}
 
-	int GetIndexCount()
+	void SetIndexBuffer(IndexBufferPtr indexBuffer)
 	{
-		return indexCount;
+		this->indexBuffer = indexBuffer;
 	}
 
-	int GetPrimitiveCount()
+	const VertexBufferPtr& GetVertexBuffer() const
 	{
-		return indexCount / 3;
+		return vertexBuffer;
 	}
 
-	bool GetTrianglePrimitive(int id, Triangle<uint16_t>& triangle)
+	const IndexBufferPtr& GetIndexBuffer() const
 	{
-		int offset = id * 3;
-		if (offset + 3 > indexCount) return false;
-		auto itor = indexBuffer.itor;
-		itor.Seek(offset);
-		triangle.v0 = *(uint16_t*)itor.Get();
-		triangle.v1 = *(uint16_t*)itor.Get();
-		triangle.v2 = *(uint16_t*)itor.Get();
-		return true;
+		return indexBuffer;
 	}
 
-private:
-	Buffer vertexBuffer;
-	int vertexCount = 0;
-	int vertexSize = 0;
+	int GetVertexCount() const
+	{
+		return (vertexBuffer != nullptr) ? vertexBuffer->GetVertexCount() : 0;
+	}
+
+	// object space bounds of the vertex positions, invalid bounds disable draw culling. Set them
+	// again after the vertices change, stale bounds cull visible draws.
+	void SetBounds(const Bounds& bounds)
+	{
+		this->bounds = bounds;
+	}
 
-	Buffer indexBuffer;
-	int indexCount = 0;
+	const Bounds& GetBounds() const
+	{
+		return bounds;
+	}
+
+	template<typename VertexType = void>
+	VertexType* GetVertexData(int index)
+	{
+		return (VertexType*)vertexBuffer->GetVertexData(index);
+	}
+
+	int GetIndexCount() const
+	{
+		return (indexBuffer != nullptr) ? indexBuffer->GetIndexCount() : 0;
+	}
+
+	int GetPrimitiveCount() const
+	{
+		return (indexBuffer != nullptr) ? indexBuffer->GetPrimitiveCount() : 0;
+	}
+
+	bool GetTrianglePrimitive(int id, Triangle<uint32_t>& triangle) const
+	{
+		return (indexBuffer != nullptr) && indexBuffer->GetTrianglePrimitive(id, triangle);
+	}
+
+private:
+	VertexBufferPtr vertexBuffer = nullptr;
+	IndexBufferPtr indexBuffer = nullptr;
+	Bounds bounds;
 };
 
 } // namespace sr
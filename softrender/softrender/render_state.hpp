@@ -112,32 +112,26 @@ struct RenderState
 		}
 	}
 
-	template <typename Type>
-	float _DeterminantOfCullingMatrix(const Type& v0, const Type& v1, const Type& v2) const
+	// det of the clip-space x, y, w rows: the facing of the triangle's plane seen from the eye,
+	// so it has the sign of the screen-space area wherever the triangle is visible, w < 0 included
+	static float _DeterminantOfCullingMatrix(const Vector4& v0, const Vector4& v1, const Vector4& v2)
 	{
-		return (v1.x - v0.x) * (v2.y - v0.y) * v0.z
-				- (v2.x - v0.x) * (v1.y - v0.y) * v0.z
-				+ (v2.x - v0.x) * v0.y * (v1.z - v0.z)
-				- (v1.x - v0.x) * v0.y * (v2.z - v0.z)
-				+ v0.x * (v1.y - v0.y) * (v2.z - v0.z)
-				- v0.x * (v2.y - v0.y) * (v1.z - v0.z);
+		return v0.x * (v1.y * v2.w - v1.w * v2.y)
+			- v0.y * (v1.x * v2.w - v1.w * v2.x)
+			+ v0.w * (v1.x * v2.y - v1.y * v2.x);
 	}
 
-	template <typename Type>
-	bool FaceCulling(const Type& v0, Type& v1, Type& v2) const
+	// pre-clip culling on clip-space positions, FaceCullingSimple still orders what is drawn
+	bool FaceCulling(const Vector4& v0, const Vector4& v1, const Vector4& v2) const
 	{
-		float det = _DeterminantOfCullingMatrix(v0.position, v1.position, v2.position);
+		float det = _DeterminantOfCullingMatrix(v0, v1, v2);
 		switch (cull)
 		{
 		case RenderState::CullType_Front:
-			if (det <= 0.f) return true;
-			std::swap(v1, v2);
-			return false;
+			return det <= 0.f;
 		case RenderState::CullType_Back:
 			return det >= 0.f;
 		case RenderState::CullType_Off:
-			if (det > 0.f) std::swap(v1, v2);
-			return false;
 		default:
 			return false;
 		}
@@ -146,7 +140,7 @@ struct RenderState
 	template <typename Type>
 	bool FaceCullingSimple(Triangle<Projection>& p, Triangle<Type>& v) const
 	{
-		int ret = Projection::Orient2D(p.v0, p.v1, p.v2);
+		int64_t ret = Projection::Orient2D(p.v0, p.v1, p.v2);
 
 		switch (cull)
 		{
@@ -12,6 +12,7 @@ RenderTexture::RenderTexture(int width, int height)
 	depthBuffer = std::make_shared<Bitmap>(width, height, Bitmap::BitmapType_AlphaFloat);
 	assert(colorBuffer != nullptr);
 	assert(depthBuffer != nullptr);
+	hiZBuffer = HiZBuffer::GetHiZBuffer(depthBuffer);
 }
 
 sr::RenderTexture::RenderTexture(BitmapPtr colorBuffer, BitmapPtr depthBuffer)
@@ -24,6 +25,7 @@ sr::RenderTexture::RenderTexture(BitmapPtr colorBuffer, BitmapPtr depthBuffer)
 	assert(this->height == depthBuffer->GetHeight());
 	this->colorBuffer = colorBuffer;
 	this->depthBuffer = depthBuffer;
+	hiZBuffer = HiZBuffer::GetHiZBuffer(depthBuffer);
 }
 
 BitmapPtr RenderTexture::CreateGBuffer(int index, Bitmap::BitmapType format)
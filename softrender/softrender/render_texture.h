@@ -3,6 +3,7 @@
 
 #include "base/header.h"
 #include "softrender/bitmap.h"
+#include "softrender/hiz_buffer.h"
 #include "math/color.h"
 #include "math/vector2.h"
 
@@ -27,11 +28,15 @@ public:
 
 	BitmapPtr GetColorBuffer() { return colorBuffer; }
 	BitmapPtr GetDepthBuffer() { return depthBuffer; }
+	// coarse depth bounds of the depth buffer, kept in sync by SoftRender and shared by every
+	// render texture over the same depth bitmap
+	HiZBufferPtr GetHiZBuffer() { return hiZBuffer; }
 	BitmapPtr GetGBuffer(int index);
 
 protected:
 	BitmapPtr colorBuffer = nullptr;
 	BitmapPtr depthBuffer = nullptr;
+	HiZBufferPtr hiZBuffer = nullptr;
 	BitmapPtr gbuffer0 = nullptr;
 	BitmapPtr gbuffer1 = nullptr;
 	BitmapPtr gbuffer2 = nullptr;
@@ -14,35 +14,128 @@ namespace sr
 struct IShader;
 typedef std::shared_ptr<IShader> ShaderPtr;
 
-struct IShader
+// outputs of the four pixels of a 2x2 quad, index i is pixel i of the quad
+struct PixelQuadOutput
 {
-	int varyingDataSize;
-	rawptr_t varyingData = nullptr;
+	Color SV_Target0[4];
+	Color SV_Target1[4];
+	Color SV_Target2[4];
+	Color SV_Target3[4];
+	// holds the interpolated depth on input
+	float SV_Depth[4];
+	// pixels discarded by Clip
+	uint8_t clipMask = 0;
+};
 
-	// alpha test
-	bool isClipped;
+// The varyings of a quad's four pixels, as structs through operator[] or as SoA lanes:
+// Lanes(quad[0].field) points at the 4 values of a float field, transposed on first use.
+template<typename VaryingDataType>
+struct VaryingQuad
+{
+	static const int FLOAT_COUNT = sizeof(VaryingDataType) / sizeof(float);
 
-	//uniform
-	Matrix4x4 _MATRIX_MVP;
-	Matrix4x4 _MATRIX_MV;
+	explicit VaryingQuad(const rawptr_t quadVaryingData[4])
+	{
+		for (int i = 0; i < 4; ++i) pixels[i] = quadVaryingData[i];
+	}
+
+	const VaryingDataType& operator[](int index) const
+	{
+		return *(const VaryingDataType*)pixels[index];
+	}
+
+	const float* Lanes(const float& field) const
+	{
+		int component = (int)(&field - (const float*)pixels[0]);
+		assert(component >= 0 && component < FLOAT_COUNT);
+		if (!isTransposed)
+		{
+			for (int c = 0; c < FLOAT_COUNT; ++c)
+			{
+				for (int i = 0; i < 4; ++i) soa[c * 4 + i] = ((const float*)pixels[i])[c];
+			}
+			isTransposed = true;
+		}
+		return soa + component * 4;
+	}
+
+	const rawptr_t* GetVaryingData() const
+	{
+		return pixels;
+	}
+
+private:
+	rawptr_t pixels[4];
+	SIMD_ALIGN mutable float soa[FLOAT_COUNT * 4];
+	mutable bool isTransposed = false;
+};
+
+// Uniform blocks, cached by the render context and recomputed only when their inputs change.
+// Shaders read them through IShader's _Camera, _Light and _Object, e.g. _Object->_MATRIX_MVP.
+struct CameraUniforms
+{
 	Matrix4x4 _WorldToCamera;
 	Matrix4x4 _CameraToWorld;
 	Matrix4x4 _MATRIX_P;
 	Matrix4x4 _MATRIX_VP;
-	Matrix4x4 _Object2World;
-	Matrix4x4 _World2Object;
-
-	// uniform camera
 	Vector3 _WorldSpaceCameraPos;
 	Vector4 _ScreenParams;
 	Vector4 _ZBufferParams;
+};
 
-	// light
+struct LightUniforms
+{
 	Vector4 _WorldSpaceLightPos;
 	Color _LightColor;
 	Vector4 _LightAtten; // atten0, atten1, atten2, range
 	Vector3 _SpotLightDir;
 	Vector3 _SpotLightParams; // cos(phi/2), cos(theta/2), falloff
+};
+
+struct ObjectUniforms
+{
+	Matrix4x4 _MATRIX_MVP;
+	Matrix4x4 _MATRIX_MV;
+	Matrix4x4 _Object2World;
+	Matrix4x4 _World2Object;
+};
+
+struct IShader
+{
+	// bound by the render context before every draw, to its own cached blocks
+	const CameraUniforms* _Camera = nullptr;
+	const LightUniforms* _Light = nullptr;
+	const ObjectUniforms* _Object = nullptr;
+
+	int varyingDataSize;
+	// the varying struct's elements(), nullptr when it declares none
+	const std::vector<VaryingElement>* varyingElements = nullptr;
+	rawptr_t varyingData = nullptr;
+
+	// instancing, InstanceData::userData of the instance being drawn
+	int SV_InstanceID = 0;
+	rawptr_t instanceData = nullptr;
+
+	template<typename Type>
+	const Type& GetInstanceData() const
+	{
+		assert(instanceData != nullptr);
+		return *(const Type*)instanceData;
+	}
+
+	// alpha test
+	bool isClipped;
+
+	// pixel stage declarations, they pick early or late depth testing for the draw:
+	// hasClip if frag may call Clip, writesDepth if frag outputs SV_Depth.
+	// An undeclared Clip sets hasClip on first call, the quad it ran in has its early writes undone.
+	bool hasClip = false;
+	bool writesDepth = false;
+	// vertex stage declaration: set when vert outputs _MATRIX_MVP * position, which lets draws be
+	// culled by their RenderData bounds. Off by default, a vert that displaces, skins or outputs
+	// anything else would be culled wrongly. The bounds come from the vertex buffer.
+	bool isPositionFromMVP = false;
+
 	// uniform time
 	//Vector4 _Time;
 	//Vector4 _SinTime;
@@ -53,11 +146,100 @@ struct IShader
 	Color SV_Target1;
 	Color SV_Target2;
 	Color SV_Target3;
+	float SV_Depth;
+
+	// the varyings of the quad being shaded and the pixel frag runs for, for ddx / ddy. Set by
+	// every quad entry point, nullptr when pixels are shaded one at a time.
+	const rawptr_t* quadPixels = nullptr;
+	int quadPixelIndex = 0;
 
 	virtual void _VSMain(const rawptr_t input) = 0;
 	virtual void _PSMain() = 0;
 	virtual void _PassQuad(const rawptr_t quadVaryingData[4]) {}
 
+	// Shades the pixels of maskCode in one call. The default runs _PSMain per pixel;
+	// shaders override it to work across the quad.
+	virtual void _PSQuad(const rawptr_t quadVaryingData[4], uint8_t maskCode, PixelQuadOutput& output)
+	{
+		output.clipMask = 0;
+		quadPixels = quadVaryingData;
+		for (int i = 0; i < 4; ++i)
+		{
+			if (!(maskCode & (1 << i))) continue;
+
+			varyingData = quadVaryingData[i];
+			quadPixelIndex = i;
+			isClipped = false;
+			SV_Target0 = Color::clear;
+			SV_Target1 = Color::clear;
+			SV_Target2 = Color::clear;
+			SV_Target3 = Color::clear;
+			SV_Depth = output.SV_Depth[i];
+			_PSMain();
+
+			if (isClipped) output.clipMask |= (1 << i);
+			output.SV_Target0[i] = SV_Target0;
+			output.SV_Target1[i] = SV_Target1;
+			output.SV_Target2[i] = SV_Target2;
+			output.SV_Target3[i] = SV_Target3;
+			output.SV_Depth[i] = SV_Depth;
+		}
+		quadPixels = nullptr;
+	}
+
+	// the pixel of the quad whose varyings hold value and value's offset in them, -1 when value
+	// isn't a varying member of the quad being shaded
+	template<typename Type>
+	int FindQuadPixel(const Type& value, intptr_t& offset) const
+	{
+		if (quadPixels == nullptr) return -1;
+		for (int i = 0; i < 4; ++i)
+		{
+			offset = (intptr_t)&value - (intptr_t)quadPixels[i];
+			if (offset >= 0 && offset + (intptr_t)sizeof(Type) <= varyingDataSize) return i;
+		}
+		return -1;
+	}
+
+	template<typename Type>
+	bool IsQuadVarying(const Type& value) const
+	{
+		intptr_t offset;
+		return FindQuadPixel(value, offset) >= 0;
+	}
+
+	// the same varying member in another pixel of the quad
+	template<typename Type>
+	const Type& QuadValue(const Type& value, int pixel) const
+	{
+		intptr_t offset;
+		int valuePixel = FindQuadPixel(value, offset);
+		assert(valuePixel >= 0);
+		return *(const Type*)(quadPixels[pixel] + offset);
+	}
+
+	// Screen-space derivatives of a varying member, read directly or through a fragQuad input, the
+	// difference to the other pixel of the quad's row (ddx) or column (ddy). Unshaded pixels of the
+	// quad are interpolated too, so every pixel has a neighbour. Members without interpolation are
+	// garbage. Zero for anything else, values computed in frag go through Shader::ddxOf / ddyOf.
+	template<typename Type>
+	Type ddx(const Type& value) const
+	{
+		intptr_t offset;
+		int pixel = FindQuadPixel(value, offset);
+		if (pixel < 0) return value - value;
+		return *(const Type*)(quadPixels[pixel | 1] + offset) - *(const Type*)(quadPixels[pixel & ~1] + offset);
+	}
+
+	template<typename Type>
+	Type ddy(const Type& value) const
+	{
+		intptr_t offset;
+		int pixel = FindQuadPixel(value, offset);
+		if (pixel < 0) return value - value;
+		return *(const Type*)(quadPixels[pixel | 2] + offset) - *(const Type*)(quadPixels[pixel & ~2] + offset);
+	}
+
 	template<typename Type>
 	static float CalcLod(const Type& ddx, const Type& ddy)
 	{
@@ -65,11 +247,19 @@ struct IShader
 		return Mathf::Max(0.f, 0.5f * Mathf::Log2(delta));
 	}
 
-	static Color Tex2D(const Texture2D& tex, const Vector2& uv, float lod = 0.f)
+	static Color Tex2D(const Texture2D& tex, const Vector2& uv, float lod)
 	{
 		return tex.Sample(uv, lod);
 	}
 
+	// The mip level comes from the quad's derivatives when uv is a varying member. Any other uv,
+	// e.g. one computed in frag, samples mip 0: pass its derivatives from ddxOf / ddyOf instead.
+	Color Tex2D(const Texture2D& tex, const Vector2& uv) const
+	{
+		if (!IsQuadVarying(uv)) return tex.Sample(uv, 0.f);
+		return tex.Sample(uv, ddx(uv), ddy(uv));
+	}
+
 	static Color Tex2D(const Texture2D& tex, const Vector2& uv, const Vector2& ddx, const Vector2& ddy)
 	{
 		return tex.Sample(uv, ddx, ddy);
@@ -126,40 +316,78 @@ struct IShader
 
 	bool Clip(float x)
 	{
+		hasClip = true;
 		return isClipped = (x < 0.f);
 	}
 
 	void InitLightArgs(const Vector3& worldPos, Vector3& lightDir, Color& lightColor)
 	{
-		lightColor = _LightColor;
-		if (Mathf::Approximately(_WorldSpaceLightPos.w, 0.f))
+		InitLightArgs(worldPos, _Light->_WorldSpaceLightPos, _Light->_LightColor, lightDir, lightColor);
+	}
+
+	// the light uniforms with the position and color of another light, e.g. a per-instance one
+	void InitLightArgs(const Vector3& worldPos, const Vector4& worldSpaceLightPos, const Color& color, Vector3& lightDir, Color& lightColor)
+	{
+		lightColor = color;
+		if (Mathf::Approximately(worldSpaceLightPos.w, 0.f))
 		{
-			lightDir = -_WorldSpaceLightPos.xyz;
+			lightDir = -worldSpaceLightPos.xyz;
 			lightColor *= 1.f;
 		}
 		else
 		{
-			lightDir = _WorldSpaceLightPos.xyz - worldPos;
+			lightDir = worldSpaceLightPos.xyz - worldPos;
 			float distance = lightDir.Length();
 			lightDir /= distance;
 
-			lightColor *= 1.f / (_LightAtten.x + _LightAtten.y * distance + _LightAtten.z * distance * distance);
-			if (_SpotLightParams.x >= 0.f)
+			const LightUniforms& light = *_Light;
+			lightColor *= 1.f / (light._LightAtten.x + light._LightAtten.y * distance + light._LightAtten.z * distance * distance);
+			if (light._SpotLightParams.x >= 0.f)
 			{
-				float spotLightFactor = ((-_SpotLightDir).Dot(lightDir) - _SpotLightParams.x) / (_SpotLightParams.y - _SpotLightParams.x);
-				spotLightFactor = Mathf::Clamp01(Mathf::Pow(spotLightFactor, _SpotLightParams.z));
+				float spotLightFactor = ((-light._SpotLightDir).Dot(lightDir) - light._SpotLightParams.x) / (light._SpotLightParams.y - light._SpotLightParams.x);
+				spotLightFactor = Mathf::Clamp01(Mathf::Pow(spotLightFactor, light._SpotLightParams.z));
 				lightColor *= spotLightFactor;
 			}
 		}
 	}
 };
 
+// Base of a varying struct whose clip-space member is named position and whose other members
+// are smooth: struct V2F : ClipPositionVarying<V2F> { Vector4 position; ... };
+// Only the clipper reads position, the pixel stage never does, so it is never interpolated.
+template <typename VaryingDataType>
+struct ClipPositionVarying
+{
+	static const std::vector<VaryingElement>& elements()
+	{
+		static std::vector<VaryingElement> _elements
+		{
+			{ (int)offsetof(VaryingDataType, position), (int)sizeof(Vector4), VaryingInterpolation_None },
+		};
+
+		return _elements;
+	}
+};
+
+// Type::elements() when the struct declares one, nullptr otherwise
+template <typename Type>
+struct VaryingElementsOf
+{
+	template <typename T>
+	static const std::vector<VaryingElement>* Find(decltype(&T::elements)) { return &T::elements(); }
+	template <typename T>
+	static const std::vector<VaryingElement>* Find(...) { return nullptr; }
+
+	static const std::vector<VaryingElement>* Get() { return Find<Type>(nullptr); }
+};
+
 template <typename VSInputType, typename VaryingDataType>
 struct Shader : IShader
 {
 	Shader()
 	{
 		varyingDataSize = sizeof(VaryingDataType);
+		varyingElements = VaryingElementsOf<VaryingDataType>::Get();
 	}
 
 	void _VSMain(const rawptr_t input) override
@@ -182,10 +410,44 @@ struct Shader : IShader
 		frag(*(VaryingDataType*)(varyingData));
 	}
 
+	void _PSQuad(const rawptr_t quadVaryingData[4], uint8_t maskCode, PixelQuadOutput& output) override
+	{
+		quadPixels = quadVaryingData;
+		fragQuad(VaryingQuad<VaryingDataType>(quadVaryingData), maskCode, output);
+		quadPixels = nullptr;
+	}
+
+	// Derivatives of a value computed in frag from the varyings, e.g. a tiled or parallax uv:
+	// value(const VaryingDataType&) is evaluated for the neighbouring pixels of the quad.
+	// Zero when pixels are shaded one at a time.
+	template<typename Func>
+	auto ddxOf(const Func& value) const -> decltype(value(std::declval<const VaryingDataType&>()))
+	{
+		if (quadPixels == nullptr)
+		{
+			auto pixelValue = value(*(const VaryingDataType*)varyingData);
+			return pixelValue - pixelValue;
+		}
+		return value(*(const VaryingDataType*)quadPixels[quadPixelIndex | 1])
+			- value(*(const VaryingDataType*)quadPixels[quadPixelIndex & ~1]);
+	}
+
+	template<typename Func>
+	auto ddyOf(const Func& value) const -> decltype(value(std::declval<const VaryingDataType&>()))
+	{
+		if (quadPixels == nullptr)
+		{
+			auto pixelValue = value(*(const VaryingDataType*)varyingData);
+			return pixelValue - pixelValue;
+		}
+		return value(*(const VaryingDataType*)quadPixels[quadPixelIndex | 2])
+			- value(*(const VaryingDataType*)quadPixels[quadPixelIndex & ~2]);
+	}
+
 	virtual VaryingDataType vert(const VSInputType& input)
 	{
 		VaryingDataType output;
-		output.position = _MATRIX_MVP.MultiplyPoint(input.position);
+		output.position = _Object->_MATRIX_MVP.MultiplyPoint(input.position);
 		return output;
 	}
 
@@ -197,6 +459,14 @@ struct Shader : IShader
 	{
 		SV_Target0 = Color::clear;
 	}
+
+	// Optional quad entry point: shade the pixels of maskCode, fill every output of those
+	// pixels and set clipMask bits instead of calling Clip. The default runs frag per pixel.
+	// ddx / ddy and Tex2D derive mip levels from input[i] members, ddxOf / ddyOf need frag.
+	virtual void fragQuad(const VaryingQuad<VaryingDataType>& input, uint8_t maskCode, PixelQuadOutput& output)
+	{
+		IShader::_PSQuad(input.GetVaryingData(), maskCode, output);
+	}
 };
 
 } // namespace sr
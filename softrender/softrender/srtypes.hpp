@@ -13,36 +13,93 @@ namespace sr
 
 struct Projection
 {
+	// screen position in fixed point with subPixelBits fractional bits, pixel samples on integer coordinates
 	int x = 0;
 	int y = 0;
 	float z = 0.f;
 	float invW = 1.0f;
 
-	static Projection CalculateViewProjection(const Vector4& position, uint32_t width, uint32_t height)
+	static Projection CalculateViewProjection(const Vector4& position, uint32_t width, uint32_t height, int subPixelBits = 0)
 	{
 		float w = position.w;
 		assert(w > 0.f);
 		float invW = 1.f / w;
+		float scale = (float)(1 << subPixelBits);
 
 		Projection point;
-		point.x = Mathf::RoundToInt(((position.x * invW) + 1.f) / 2.f * width);
-		point.y = Mathf::RoundToInt(((position.y * invW) + 1.f) / 2.f * height);
+		point.x = Mathf::RoundToInt(((position.x * invW) + 1.f) / 2.f * width * scale);
+		point.y = Mathf::RoundToInt(((position.y * invW) + 1.f) / 2.f * height * scale);
 		point.z = position.z * invW;
 		point.invW = invW;
 		return point;
 	}
 
-	static int Orient2D(int x0, int y0, int x1, int y1, int x2, int y2)
+	// 64 bits: products of fixed-point coordinates overflow an int
+	static int64_t Orient2D(int x0, int y0, int x1, int y1, int x2, int y2)
 	{
-		return (x1 - x0) * (y2 - y1) - (y1 - y0) * (x2 - x1);
+		return (int64_t)(x1 - x0) * (y2 - y1) - (int64_t)(y1 - y0) * (x2 - x1);
 	}
 
-	static int Orient2D(const Projection& p0, const Projection& p1, const Projection& p2)
+	static int64_t Orient2D(const Projection& p0, const Projection& p1, const Projection& p2)
 	{
 		return Orient2D(p0.x, p0.y, p1.x, p1.y, p2.x, p2.y);
 	}
 };
 
+// A value linear in screen space over a triangle: origin + dx * x + dy * y, with x and y
+// in pixels relative to the triangle's first vertex.
+struct PlaneEquation
+{
+	float origin = 0.f;
+	float dx = 0.f;
+	float dy = 0.f;
+
+	float Evaluate(float x, float y) const { return origin + dx * x + dy * y; }
+};
+
+// The per-triangle half of plane setup, shared by every plane the triangle interpolates.
+// Needs a non-zero area.
+struct PlaneSetup
+{
+	float x0 = 0.f;
+	float y0 = 0.f;
+	float dx1 = 0.f, dx2 = 0.f;
+	float dy1 = 0.f, dy2 = 0.f;
+
+	PlaneSetup() = default;
+	PlaneSetup(const Projection& p0, const Projection& p1, const Projection& p2, int subPixelBits)
+	{
+		float scale = 1.f / (float)(1 << subPixelBits);
+		x0 = (float)p0.x * scale;
+		y0 = (float)p0.y * scale;
+
+		float e1x = (float)(p1.x - p0.x) * scale;
+		float e1y = (float)(p1.y - p0.y) * scale;
+		float e2x = (float)(p2.x - p0.x) * scale;
+		float e2y = (float)(p2.y - p0.y) * scale;
+		float area = (float)Projection::Orient2D(p0, p1, p2) * scale * scale;
+		assert(area != 0.f);
+		float invArea = 1.f / area;
+
+		dx1 = e2y * invArea;
+		dx2 = -e1y * invArea;
+		dy1 = -e2x * invArea;
+		dy2 = e1x * invArea;
+	}
+
+	PlaneEquation Calculate(float f0, float f1, float f2) const
+	{
+		float d1 = f1 - f0;
+		float d2 = f2 - f0;
+
+		PlaneEquation plane;
+		plane.origin = f0;
+		plane.dx = d1 * dx1 + d2 * dx2;
+		plane.dy = d1 * dy1 + d2 * dy2;
+		return plane;
+	}
+};
+
 template <typename Type>
 struct Line
 {
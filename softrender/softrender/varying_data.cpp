@@ -36,7 +36,7 @@ void VaryingDataBuffer::ResetDynamicVaryingData()
 
 void VaryingDataBuffer::InitPixelVaryingData(int slot)
 {
-	pixelVaryingDataBuffer.Initialize(varyingDataSize, false);
+	pixelVaryingDataBuffer.Initialize(GetPaddedFloatCount() * sizeof(float), false);
 	pixelVaryingDataBuffer.Alloc(slot);
 
 	pixelVaryingData.assign(slot, VertexVaryingData(this));
@@ -46,9 +46,47 @@ void VaryingDataBuffer::InitPixelVaryingData(int slot)
 	}
 }
 
-void VaryingDataBuffer::InitVaryingDataBuffer(int varyingDataSize)
+void VaryingDataBuffer::ResetVertexCache(int vertexCount)
+{
+	// entries of older generations read as empty, so nothing is cleared per draw
+	if (++generation == 0)
+	{
+		std::fill(vertexCacheGeneration.begin(), vertexCacheGeneration.end(), 0);
+		generation = 1;
+	}
+	if (vertexCount > (int)vertexCacheGeneration.size())
+	{
+		vertexCacheGeneration.resize(vertexCount, 0);
+		vertexCacheSlot.resize(vertexCount, 0);
+	}
+
+	cachedVaryingData.clear();
+	cachedVaryingDataBuffer.Initialize(varyingDataSize, true);
+	cachedVaryingDataBuffer.itor.Seek(0);
+}
+
+VertexVaryingData* VaryingDataBuffer::FindCachedVertex(int index)
+{
+	assert(index >= 0 && index < (int)vertexCacheGeneration.size());
+	if (vertexCacheGeneration[index] != generation) return nullptr;
+	return &cachedVaryingData[vertexCacheSlot[index]];
+}
+
+VertexVaryingData& VaryingDataBuffer::AddCachedVertex(int index)
+{
+	assert(index >= 0 && index < (int)vertexCacheGeneration.size());
+	vertexCacheGeneration[index] = generation;
+	vertexCacheSlot[index] = (int)cachedVaryingData.size();
+
+	cachedVaryingData.emplace_back(this);
+	cachedVaryingData.back().data = cachedVaryingDataBuffer.itor.Get();
+	return cachedVaryingData.back();
+}
+
+void VaryingDataBuffer::InitVaryingDataBuffer(int varyingDataSize, const std::vector<VaryingElement>* elements)
 {
 	this->varyingDataSize = varyingDataSize;
+	varyingLayout.Initialize(varyingDataSize, GetPaddedFloatCount(), elements);
 }
 
 int VaryingDataBuffer::GetVaryingDataSize() const
@@ -56,6 +94,68 @@ int VaryingDataBuffer::GetVaryingDataSize() const
 	return varyingDataSize;
 }
 
+int VaryingDataBuffer::GetPaddedFloatCount() const
+{
+	int floatCount = varyingDataSize / sizeof(float);
+	return (floatCount + SIMD_FLOAT_COUNT - 1) / SIMD_FLOAT_COUNT * SIMD_FLOAT_COUNT;
+}
+
+const VaryingLayout& VaryingDataBuffer::GetVaryingLayout() const
+{
+	return varyingLayout;
+}
+
+void VaryingLayout::Initialize(int varyingDataSize, int paddedFloatCount, const std::vector<VaryingElement>* elements)
+{
+	int dataFloatCount = varyingDataSize / sizeof(float);
+	floatCount = paddedFloatCount;
+	interpolations.assign(floatCount, VaryingInterpolation_None);
+	std::fill(interpolations.begin(), interpolations.begin() + dataFloatCount, VaryingInterpolation_Smooth);
+	if (elements != nullptr)
+	{
+		for (auto& element : *elements)
+		{
+			assert(element.offset % sizeof(float) == 0 && element.size % sizeof(float) == 0);
+			assert(element.offset + element.size <= varyingDataSize);
+			int first = element.offset / sizeof(float);
+			int last = Mathf::Min((int)((element.offset + element.size) / sizeof(float)), dataFloatCount);
+			for (int i = first; i < last; ++i) interpolations[i] = element.interpolation;
+		}
+	}
+
+	perspectiveMasks.resize(floatCount);
+	for (int i = 0; i < floatCount; ++i)
+	{
+		perspectiveMasks[i] = (interpolations[i] == VaryingInterpolation_Smooth) ? 0xFFFFFFFF : 0x0;
+	}
+
+	CalculateChunkTypes(chunkTypes4, 4);
+	CalculateChunkTypes(chunkTypes8, 8);
+}
+
+void VaryingLayout::CalculateChunkTypes(std::vector<ChunkType>& chunkTypes, int chunkFloatCount) const
+{
+	assert(floatCount % chunkFloatCount == 0);
+	int chunkCount = floatCount / chunkFloatCount;
+	chunkTypes.resize(chunkCount);
+	for (int c = 0; c < chunkCount; ++c)
+	{
+		int smoothCount = 0;
+		int linearCount = 0;
+		for (int i = c * chunkFloatCount; i < (c + 1) * chunkFloatCount; ++i)
+		{
+			if (interpolations[i] == VaryingInterpolation_Smooth) ++smoothCount;
+			else if (interpolations[i] != VaryingInterpolation_None) ++linearCount;
+		}
+
+		// floats that aren't interpolated may be written anyway, nobody reads them
+		if (smoothCount == 0 && linearCount == 0) chunkTypes[c] = ChunkType_Skip;
+		else if (linearCount == 0) chunkTypes[c] = ChunkType_Perspective;
+		else if (smoothCount == 0) chunkTypes[c] = ChunkType_Linear;
+		else chunkTypes[c] = ChunkType_Mixed;
+	}
+}
+
 VertexVaryingData& VaryingDataBuffer::GetPixelVaryingData(int slot)
 {
 	assert(slot >= 0 && slot < (int)pixelVaryingData.size());
@@ -74,20 +174,66 @@ VertexVaryingData VertexVaryingData::LinearInterp(const VertexVaryingData& a, co
 	assert(output.data != nullptr);
 	LinearInterpValue(output.data, a.data, b.data, varyingDataBuffer->GetVaryingDataSize(), t);
 	output.position = *Buffer::Value<Vector4>(output.data, 0);
-	output.clipCode = Clipper::CalculateClipCode(output.position);
 	return output;
 }
 
-rawptr_t VertexVaryingData::TriangleInterp(int slotIndex, const VertexVaryingData& v0, const VertexVaryingData& v1, const VertexVaryingData& v2, float x, float y, float z)
+VertexVaryingData VertexVaryingData::TriangleInterp(const VertexVaryingData& v0, const VertexVaryingData& v1, const VertexVaryingData& v2, float x, float y, float z)
 {
 	assert(v0.varyingDataBuffer != nullptr);
 	assert(v0.varyingDataBuffer == v1.varyingDataBuffer && v0.varyingDataBuffer == v2.varyingDataBuffer);
 
 	auto varyingDataBuffer = v0.varyingDataBuffer;
-	rawptr_t data = varyingDataBuffer->GetPixelVaryingData(slotIndex).data;
-	assert(data != nullptr);
-	TriangleInterpValue(data, v0.data, v1.data, v2.data, varyingDataBuffer->GetVaryingDataSize(), x, y, z);
-	return data;
+
+	VertexVaryingData output(varyingDataBuffer);
+	output.data = varyingDataBuffer->CreateDynamicVaryingData();
+	assert(output.data != nullptr);
+	// no-perspective floats are weighted by where the new vertex lands on screen
+	float sx = x * v0.position.w;
+	float sy = y * v1.position.w;
+	float sz = z * v2.position.w;
+	float invSum = 1.f / (sx + sy + sz);
+	TriangleInterpValue(output.data, v0.data, v1.data, v2.data, varyingDataBuffer->GetVaryingLayout(),
+		x, y, z, sx * invSum, sy * invSum, sz * invSum);
+	// the layout may skip position (VaryingInterpolation_None), so it is interpolated here
+	output.position = Mathf::TriangleInterp(v0.position, v1.position, v2.position, x, y, z);
+	*Buffer::Value<Vector4>(output.data, 0) = output.position;
+	return output;
+}
+
+void VertexVaryingData::CalculatePlanes(float* planes, const VaryingLayout& layout, const PlaneSetup& setup, const Triangle<VertexVaryingData>& triangle, const Triangle<Projection>& projection)
+{
+	int floatCount = layout.floatCount;
+	float* origins = planes;
+	float* dxs = planes + floatCount;
+	float* dys = planes + floatCount * 2;
+	const float* v0 = (const float*)triangle.v0.data;
+	const float* v1 = (const float*)triangle.v1.data;
+	const float* v2 = (const float*)triangle.v2.data;
+	float invW0 = projection.v0.invW;
+	float invW1 = projection.v1.invW;
+	float invW2 = projection.v2.invW;
+	for (int i = 0; i < floatCount; ++i)
+	{
+		PlaneEquation plane;
+		switch (layout.interpolations[i])
+		{
+		case VaryingInterpolation_Smooth:
+			plane = setup.Calculate(v0[i] * invW0, v1[i] * invW1, v2[i] * invW2);
+			break;
+		case VaryingInterpolation_NoPerspective:
+			plane = setup.Calculate(v0[i], v1[i], v2[i]);
+			break;
+		case VaryingInterpolation_Flat:
+			plane.origin = v0[i];
+			break;
+		default:
+			// zero, the SIMD kernels store whole chunks and must not leak the last triangle's values
+			break;
+		}
+		origins[i] = plane.origin;
+		dxs[i] = plane.dx;
+		dys[i] = plane.dy;
+	}
 }
 
 void VertexVaryingData::LinearInterpValue(rawptr_t output, const rawptr_t a, const rawptr_t b, int size, float t)
@@ -100,12 +246,170 @@ void VertexVaryingData::LinearInterpValue(rawptr_t output, const rawptr_t a, con
 	}
 }
 
-void VertexVaryingData::TriangleInterpValue(rawptr_t output, const rawptr_t a, const rawptr_t b, const rawptr_t c, int size, float x, float y, float z)
+void VertexVaryingData::TriangleInterpValue(rawptr_t output, const rawptr_t a, const rawptr_t b, const rawptr_t c, const VaryingLayout& layout,
+	float x, float y, float z, float sx, float sy, float sz)
 {
-	int offset = 0;
-	while (offset < size)
+	float* result = (float*)output;
+	const float* fa = (const float*)a;
+	const float* fb = (const float*)b;
+	const float* fc = (const float*)c;
+	for (int i = 0; i < layout.floatCount; ++i)
 	{
-		*Buffer::Value<float>(output, offset) = Mathf::TriangleInterp(*Buffer::Value<float>(a, offset), *Buffer::Value<float>(b, offset), *Buffer::Value<float>(c, offset), x, y, z);
-		offset += sizeof(float);
+		switch (layout.interpolations[i])
+		{
+		case VaryingInterpolation_Smooth:
+			result[i] = Mathf::TriangleInterp(fa[i], fb[i], fc[i], x, y, z);
+			break;
+		case VaryingInterpolation_NoPerspective:
+			result[i] = Mathf::TriangleInterp(fa[i], fb[i], fc[i], sx, sy, sz);
+			break;
+		case VaryingInterpolation_Flat:
+			result[i] = fa[i];
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void VertexVaryingData::PlaneInterpValue(rawptr_t output[4], const float* planes, const VaryingLayout& layout, float x, float y, const float w[4])
+{
+	int floatCount = layout.floatCount;
+	const float* origins = planes;
+	const float* dxs = planes + floatCount;
+	const float* dys = planes + floatCount * 2;
+	float* output0 = (float*)output[0];
+	float* output1 = (float*)output[1];
+	float* output2 = (float*)output[2];
+	float* output3 = (float*)output[3];
+	for (int i = 0; i < floatCount; ++i)
+	{
+		VaryingInterpolation interpolation = layout.interpolations[i];
+		if (interpolation == VaryingInterpolation_None) continue;
+
+		float value = origins[i] + dxs[i] * x + dys[i] * y;
+		float valueRight = value + dxs[i];
+		float valueBottom = value + dys[i];
+		float valueBottomRight = valueRight + dys[i];
+		if (interpolation == VaryingInterpolation_Smooth)
+		{
+			value *= w[0];
+			valueRight *= w[1];
+			valueBottom *= w[2];
+			valueBottomRight *= w[3];
+		}
+		output0[i] = value;
+		output1[i] = valueRight;
+		output2[i] = valueBottom;
+		output3[i] = valueBottomRight;
+	}
+}
+
+#if _SIMD_X86_
+// pixel blocks are only 16-byte aligned, so loads and stores are unaligned
+SIMD_TARGET_SSE41 void VertexVaryingData::PlaneInterpValueSSE41(rawptr_t output[4], const float* planes, const VaryingLayout& layout, float x, float y, const float w[4])
+{
+	int floatCount = layout.floatCount;
+	const float* origins = planes;
+	const float* dxs = planes + floatCount;
+	const float* dys = planes + floatCount * 2;
+	float* output0 = (float*)output[0];
+	float* output1 = (float*)output[1];
+	float* output2 = (float*)output[2];
+	float* output3 = (float*)output[3];
+
+	__m128 mf_x = _mm_set1_ps(x);
+	__m128 mf_y = _mm_set1_ps(y);
+	__m128 mf_one = _mm_set1_ps(1.f);
+	__m128 mf_w0 = _mm_set1_ps(w[0]);
+	__m128 mf_w1 = _mm_set1_ps(w[1]);
+	__m128 mf_w2 = _mm_set1_ps(w[2]);
+	__m128 mf_w3 = _mm_set1_ps(w[3]);
+	for (int chunk = 0; chunk < (int)layout.chunkTypes4.size(); ++chunk)
+	{
+		VaryingLayout::ChunkType chunkType = layout.chunkTypes4[chunk];
+		if (chunkType == VaryingLayout::ChunkType_Skip) continue;
+
+		int i = chunk * 4;
+		__m128 mf_dx = _mm_loadu_ps(dxs + i);
+		__m128 mf_dy = _mm_loadu_ps(dys + i);
+		__m128 mf_value = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(origins + i), _mm_mul_ps(mf_dx, mf_x)), _mm_mul_ps(mf_dy, mf_y));
+		__m128 mf_valueRight = _mm_add_ps(mf_value, mf_dx);
+		__m128 mf_valueBottom = _mm_add_ps(mf_value, mf_dy);
+		__m128 mf_valueBottomRight = _mm_add_ps(mf_valueRight, mf_dy);
+
+		if (chunkType == VaryingLayout::ChunkType_Perspective)
+		{
+			mf_value = _mm_mul_ps(mf_value, mf_w0);
+			mf_valueRight = _mm_mul_ps(mf_valueRight, mf_w1);
+			mf_valueBottom = _mm_mul_ps(mf_valueBottom, mf_w2);
+			mf_valueBottomRight = _mm_mul_ps(mf_valueBottomRight, mf_w3);
+		}
+		else if (chunkType == VaryingLayout::ChunkType_Mixed)
+		{
+			__m128 mf_mask = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&layout.perspectiveMasks[i]));
+			mf_value = _mm_mul_ps(mf_value, _mm_blendv_ps(mf_one, mf_w0, mf_mask));
+			mf_valueRight = _mm_mul_ps(mf_valueRight, _mm_blendv_ps(mf_one, mf_w1, mf_mask));
+			mf_valueBottom = _mm_mul_ps(mf_valueBottom, _mm_blendv_ps(mf_one, mf_w2, mf_mask));
+			mf_valueBottomRight = _mm_mul_ps(mf_valueBottomRight, _mm_blendv_ps(mf_one, mf_w3, mf_mask));
+		}
+		_mm_storeu_ps(output0 + i, mf_value);
+		_mm_storeu_ps(output1 + i, mf_valueRight);
+		_mm_storeu_ps(output2 + i, mf_valueBottom);
+		_mm_storeu_ps(output3 + i, mf_valueBottomRight);
+	}
+}
+
+SIMD_TARGET_AVX2 void VertexVaryingData::PlaneInterpValueAVX2(rawptr_t output[4], const float* planes, const VaryingLayout& layout, float x, float y, const float w[4])
+{
+	int floatCount = layout.floatCount;
+	const float* origins = planes;
+	const float* dxs = planes + floatCount;
+	const float* dys = planes + floatCount * 2;
+	float* output0 = (float*)output[0];
+	float* output1 = (float*)output[1];
+	float* output2 = (float*)output[2];
+	float* output3 = (float*)output[3];
+
+	__m256 mf_x = _mm256_set1_ps(x);
+	__m256 mf_y = _mm256_set1_ps(y);
+	__m256 mf_one = _mm256_set1_ps(1.f);
+	__m256 mf_w0 = _mm256_set1_ps(w[0]);
+	__m256 mf_w1 = _mm256_set1_ps(w[1]);
+	__m256 mf_w2 = _mm256_set1_ps(w[2]);
+	__m256 mf_w3 = _mm256_set1_ps(w[3]);
+	for (int chunk = 0; chunk < (int)layout.chunkTypes8.size(); ++chunk)
+	{
+		VaryingLayout::ChunkType chunkType = layout.chunkTypes8[chunk];
+		if (chunkType == VaryingLayout::ChunkType_Skip) continue;
+
+		int i = chunk * 8;
+		__m256 mf_dx = _mm256_loadu_ps(dxs + i);
+		__m256 mf_dy = _mm256_loadu_ps(dys + i);
+		__m256 mf_value = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(origins + i), _mm256_mul_ps(mf_dx, mf_x)), _mm256_mul_ps(mf_dy, mf_y));
+		__m256 mf_valueRight = _mm256_add_ps(mf_value, mf_dx);
+		__m256 mf_valueBottom = _mm256_add_ps(mf_value, mf_dy);
+		__m256 mf_valueBottomRight = _mm256_add_ps(mf_valueRight, mf_dy);
+
+		if (chunkType == VaryingLayout::ChunkType_Perspective)
+		{
+			mf_value = _mm256_mul_ps(mf_value, mf_w0);
+			mf_valueRight = _mm256_mul_ps(mf_valueRight, mf_w1);
+			mf_valueBottom = _mm256_mul_ps(mf_valueBottom, mf_w2);
+			mf_valueBottomRight = _mm256_mul_ps(mf_valueBottomRight, mf_w3);
+		}
+		else if (chunkType == VaryingLayout::ChunkType_Mixed)
+		{
+			__m256 mf_mask = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&layout.perspectiveMasks[i]));
+			mf_value = _mm256_mul_ps(mf_value, _mm256_blendv_ps(mf_one, mf_w0, mf_mask));
+			mf_valueRight = _mm256_mul_ps(mf_valueRight, _mm256_blendv_ps(mf_one, mf_w1, mf_mask));
+			mf_valueBottom = _mm256_mul_ps(mf_valueBottom, _mm256_blendv_ps(mf_one, mf_w2, mf_mask));
+			mf_valueBottomRight = _mm256_mul_ps(mf_valueBottomRight, _mm256_blendv_ps(mf_one, mf_w3, mf_mask));
+		}
+		_mm256_storeu_ps(output0 + i, mf_value);
+		_mm256_storeu_ps(output1 + i, mf_valueRight);
+		_mm256_storeu_ps(output2 + i, mf_valueBottom);
+		_mm256_storeu_ps(output3 + i, mf_valueBottomRight);
 	}
 }
+#endif
@@ -12,6 +12,64 @@
 namespace sr
 {
 
+enum VaryingInterpolation
+{
+	// perspective-correct, the default
+	VaryingInterpolation_Smooth,
+	// linear in screen space
+	VaryingInterpolation_NoPerspective,
+	// the first vertex of the primitive for every pixel
+	VaryingInterpolation_Flat,
+	// never interpolated, for members the pixel stage doesn't read (e.g. a position only the clipper needs)
+	VaryingInterpolation_None,
+};
+
+// One member of a varying struct, as listed by the struct's optional static elements():
+//	static const std::vector<VaryingElement>& elements()
+//	{
+//		static std::vector<VaryingElement> _elements
+//		{
+//			{ offsetof(V2F, position), sizeof(Vector4), VaryingInterpolation_None },
+//		};
+//		return _elements;
+//	}
+// Members left out are smooth. ClipPositionVarying in shader.hpp declares the common
+// "position None, rest smooth" layout.
+struct VaryingElement
+{
+	int offset;
+	int size;
+	VaryingInterpolation interpolation;
+};
+
+// per-float interpolation of a varying struct, padded to VaryingDataBuffer::SIMD_FLOAT_COUNT
+struct VaryingLayout
+{
+	// how a chunk of one SIMD register's floats is interpolated, so SIMD kernels pick one path per chunk
+	enum ChunkType
+	{
+		ChunkType_Skip,
+		// every float is scaled by w
+		ChunkType_Perspective,
+		// no float is scaled by w
+		ChunkType_Linear,
+		ChunkType_Mixed,
+	};
+
+	int floatCount = 0;
+	std::vector<VaryingInterpolation> interpolations;
+	// all bits set for the floats scaled by w, a blend mask for mixed chunks
+	std::vector<uint32_t> perspectiveMasks;
+	// chunks of 4 and 8 floats, the SSE and AVX register widths
+	std::vector<ChunkType> chunkTypes4;
+	std::vector<ChunkType> chunkTypes8;
+
+	void Initialize(int varyingDataSize, int paddedFloatCount, const std::vector<VaryingElement>* elements);
+
+private:
+	void CalculateChunkTypes(std::vector<ChunkType>& chunkTypes, int chunkFloatCount) const;
+};
+
 class VaryingDataBuffer;
 struct VertexVaryingData
 {
@@ -25,18 +83,37 @@ struct VertexVaryingData
 	VertexVaryingData() = default;
 	explicit VertexVaryingData(VaryingDataBuffer* _varyingDataBuffer) : varyingDataBuffer(_varyingDataBuffer) {}
 	static VertexVaryingData LinearInterp(const VertexVaryingData& a, const VertexVaryingData& b, float t);
-	static rawptr_t TriangleInterp(int slot, const VertexVaryingData& v0, const VertexVaryingData& v1, const VertexVaryingData& v2, float x, float y, float z);
+	// a new dynamic vertex, weighted x, y, z over v0, v1, v2
+	static VertexVaryingData TriangleInterp(const VertexVaryingData& v0, const VertexVaryingData& v1, const VertexVaryingData& v2, float x, float y, float z);
+
+	// One plane per varying float, so a pixel is its plane, times the pixel's w for smooth floats (whose
+	// planes are of the float divided by w). The planes are stored as origins, then dx, then dy, each
+	// layout.floatCount long; the planes of floats that aren't interpolated are zero.
+	static void CalculatePlanes(float* planes, const VaryingLayout& layout, const PlaneSetup& setup, const Triangle<VertexVaryingData>& triangle, const Triangle<Projection>& projection);
 
 	static void LinearInterpValue(rawptr_t output, const rawptr_t a, const rawptr_t b, int size, float t);
-	static void TriangleInterpValue(rawptr_t output, const rawptr_t a, const rawptr_t b, const rawptr_t c, int size, float x, float y, float z);
+	// x, y, z weight smooth floats, sx, sy, sz (the screen-space weights) no-perspective ones
+	static void TriangleInterpValue(rawptr_t output, const rawptr_t a, const rawptr_t b, const rawptr_t c, const VaryingLayout& layout,
+		float x, float y, float z, float sx, float sy, float sz);
+	// the four pixels of a quad, (x, y) is the quad position relative to the planes' origin;
+	// the SIMD versions run lanes across varyings and write whole padded pixel blocks
+	static void PlaneInterpValue(rawptr_t output[4], const float* planes, const VaryingLayout& layout, float x, float y, const float w[4]);
+#if _SIMD_X86_
+	SIMD_TARGET_SSE41 static void PlaneInterpValueSSE41(rawptr_t output[4], const float* planes, const VaryingLayout& layout, float x, float y, const float w[4]);
+	SIMD_TARGET_AVX2 static void PlaneInterpValueAVX2(rawptr_t output[4], const float* planes, const VaryingLayout& layout, float x, float y, const float w[4]);
+#endif
 };
 
 class VaryingDataBuffer
 {
 public:
+	// pixel varying blocks and attribute planes are padded to a multiple of the widest SIMD kernel
+	static const int SIMD_FLOAT_COUNT = 8;
+
 	VaryingDataBuffer() = default;
 
-	void InitVaryingDataBuffer(int varyingDataSize);
+	// elements of the varying struct, nullptr interpolates every float smoothly
+	void InitVaryingDataBuffer(int varyingDataSize, const std::vector<VaryingElement>* elements = nullptr);
 	void InitVerticesVaryingData(int vertexCount);
 	VertexVaryingData& GetVertexVaryingData(int index);
 	void InitDynamicVaryingData();
@@ -45,15 +122,30 @@ public:
 	void InitPixelVaryingData(int slot);
 	VertexVaryingData& GetPixelVaryingData(int slot);
 
+	// Post-transform cache for on-demand vertex shading: ResetVertexCache forgets every
+	// vertex without touching them, FindCachedVertex is nullptr until AddCachedVertex.
+	void ResetVertexCache(int vertexCount);
+	VertexVaryingData* FindCachedVertex(int index);
+	VertexVaryingData& AddCachedVertex(int index);
+
 	int GetVaryingDataSize() const;
+	int GetPaddedFloatCount() const;
+	const VaryingLayout& GetVaryingLayout() const;
 
 private:
 	int varyingDataSize = 0;
+	VaryingLayout varyingLayout;
 	std::vector<VertexVaryingData> vertexVaryingData;
 	std::vector<VertexVaryingData> pixelVaryingData;
 	Buffer vertexVaryingDataBuffer;
 	Buffer dynamicVaryingDataBuffer;
 	Buffer pixelVaryingDataBuffer;
+
+	std::vector<uint32_t> vertexCacheGeneration;
+	std::vector<int> vertexCacheSlot;
+	std::vector<VertexVaryingData> cachedVaryingData;
+	Buffer cachedVaryingDataBuffer;
+	uint32_t generation = 0;
 };
 
 } // namespace sr
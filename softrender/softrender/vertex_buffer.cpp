@@ -0,0 +1,56 @@
+#include "vertex_buffer.h"
+using namespace sr;
+
+VertexBuffer::VertexBuffer(int vertexCount, int vertexSize)
+{
+	this->vertexCount = vertexCount;
+	this->vertexSize = vertexSize;
+	data.resize(vertexCount * vertexSize);
+}
+
+int VertexBuffer::GetElementSize(Mesh::VertexElement element, const Mesh& mesh)
+{
+	switch (element)
+	{
+	case Mesh::VertexElement_Position:
+		return sizeof(Vector3);
+	case Mesh::VertexElement_Normal:
+		assert(mesh.normals.size() == mesh.vertices.size());
+		return sizeof(Vector3);
+	case Mesh::VertexElement_Tangent:
+		assert(mesh.tangents.size() == mesh.vertices.size());
+		return sizeof(Vector4);
+	case Mesh::VertexElement_Color:
+		assert(mesh.colors.size() == mesh.vertices.size());
+		return sizeof(Color);
+	case Mesh::VertexElement_Texcoord:
+		assert(mesh.texcoords.size() == mesh.vertices.size());
+		return sizeof(Vector2);
+	default:
+		return 0;
+	}
+}
+
+void VertexBuffer::WriteElement(uint8_t* output, Mesh::VertexElement element, const Mesh& mesh, int index)
+{
+	switch (element)
+	{
+	case Mesh::VertexElement_Position:
+		memcpy(output, &mesh.vertices[index], sizeof(Vector3));
+		break;
+	case Mesh::VertexElement_Normal:
+		memcpy(output, &mesh.normals[index], sizeof(Vector3));
+		break;
+	case Mesh::VertexElement_Tangent:
+		memcpy(output, &mesh.tangents[index], sizeof(Vector4));
+		break;
+	case Mesh::VertexElement_Color:
+		memcpy(output, &mesh.colors[index], sizeof(Color));
+		break;
+	case Mesh::VertexElement_Texcoord:
+		memcpy(output, &mesh.texcoords[index], sizeof(Vector2));
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,90 @@
+#ifndef _SOFTRENDER_VERTEX_BUFFER_H_
+#define _SOFTRENDER_VERTEX_BUFFER_H_
+
+#include "base/header.h"
+#include "math/vector2.h"
+#include "math/vector3.h"
+#include "math/vector4.h"
+#include "math/color.h"
+#include "math/bounds.h"
+#include "softrender/mesh.h"
+
+namespace sr
+{
+
+class VertexBuffer;
+typedef std::shared_ptr<VertexBuffer> VertexBufferPtr;
+
+// Immutable interleaved vertices, built once and shared by any number of RenderData.
+class VertexBuffer
+{
+public:
+	// interleaves the mesh attributes in the order of VertexType::elements(), the bounds are
+	// those of the positions written, invalid when the layout has none
+	template<typename VertexType>
+	static VertexBufferPtr Create(const Mesh& mesh);
+	// bounds are left invalid, draws of the buffer are not culled
+	template<typename VertexType>
+	static VertexBufferPtr Create(const std::vector<VertexType>& vertices);
+
+	int GetVertexCount() const { return vertexCount; }
+	int GetVertexSize() const { return vertexSize; }
+	const Bounds& GetBounds() const { return bounds; }
+
+	const uint8_t* GetVertexData(int index) const
+	{
+		assert(index >= 0 && index < vertexCount);
+		return data.data() + index * vertexSize;
+	}
+
+private:
+	VertexBuffer(int vertexCount, int vertexSize);
+	static int GetElementSize(Mesh::VertexElement element, const Mesh& mesh);
+	static void WriteElement(uint8_t* output, Mesh::VertexElement element, const Mesh& mesh, int index);
+
+	std::vector<uint8_t> data;
+	int vertexCount = 0;
+	int vertexSize = 0;
+	Bounds bounds;
+};
+
+template<typename VertexType>
+VertexBufferPtr VertexBuffer::Create(const Mesh& mesh)
+{
+	auto& elements = VertexType::elements();
+	int vertexElementsSize = 0;
+	for (auto element : elements) vertexElementsSize += GetElementSize(element, mesh);
+	assert(vertexElementsSize == sizeof(VertexType));
+	if (vertexElementsSize != sizeof(VertexType)) return nullptr;
+
+	int vertexCount = (int)mesh.vertices.size();
+	VertexBufferPtr vertexBuffer = VertexBufferPtr(new VertexBuffer(vertexCount, sizeof(VertexType)));
+	uint8_t* output = vertexBuffer->data.data();
+	for (int i = 0; i < vertexCount; ++i)
+	{
+		for (Mesh::VertexElement element : elements)
+		{
+			WriteElement(output, element, mesh, i);
+			output += GetElementSize(element, mesh);
+		}
+	}
+
+	if (std::find(elements.begin(), elements.end(), Mesh::VertexElement_Position) != elements.end())
+	{
+		vertexBuffer->bounds.Calculate(mesh.vertices.data(), vertexCount);
+	}
+	return vertexBuffer;
+}
+
+template<typename VertexType>
+VertexBufferPtr VertexBuffer::Create(const std::vector<VertexType>& vertices)
+{
+	int vertexCount = (int)vertices.size();
+	VertexBufferPtr vertexBuffer = VertexBufferPtr(new VertexBuffer(vertexCount, sizeof(VertexType)));
+	if (vertexCount > 0) memcpy(vertexBuffer->data.data(), vertices.data(), vertexCount * sizeof(VertexType));
+	return vertexBuffer;
+}
+
+}
+
+#endif //! _SOFTRENDER_VERTEX_BUFFER_H_
@@ -126,30 +126,30 @@ sr::MeshPtr LoadMesh(const char* path)
 	}
 
 	MeshPtr mesh = std::make_shared<Mesh>();
-	typedef std::tuple<uint16_t, uint16_t, uint16_t> MeshIndex;
-	std::map<MeshIndex, uint16_t> indexTable;
+	typedef std::tuple<int, int, int> MeshIndex;
+	std::map<MeshIndex, uint32_t> indexTable;
 	for (uint32_t i = 0; i < shapes.size(); ++i)
 	{
 		for (uint32_t j = 0; j < shapes[i].mesh.indices.size(); ++j)
 		{
 			const auto& tinyobjIndex = shapes[i].mesh.indices[j];
-			MeshIndex meshIndex { (uint16_t)tinyobjIndex.vertex_index, (uint16_t)tinyobjIndex.normal_index, (uint16_t)tinyobjIndex.texcoord_index };
+			MeshIndex meshIndex { tinyobjIndex.vertex_index, tinyobjIndex.normal_index, tinyobjIndex.texcoord_index };
 			auto index = indexTable.find(meshIndex);
 			if (index == indexTable.end())
 			{
-				uint16_t realIndex = (uint16_t)indexTable.size();
+				uint32_t realIndex = (uint32_t)indexTable.size();
 				int vi = std::get<0>(meshIndex) * 3;
 				mesh->vertices.emplace_back(attrib.vertices[vi], attrib.vertices[vi + 1], attrib.vertices[vi + 2]);
 
-				uint16_t ni_ = std::get<1>(meshIndex);
-				if (ni_ != (uint16_t)-1)
+				int ni_ = std::get<1>(meshIndex);
+				if (ni_ >= 0)
 				{
 					int ni = ni_ * 3;
 					mesh->normals.emplace_back(attrib.normals[ni], attrib.normals[ni + 1], attrib.normals[ni + 2]);
 				}
 
-				uint16_t ti_ = std::get<2>(meshIndex);
-				if (ti_ != (uint16_t)-1)
+				int ti_ = std::get<2>(meshIndex);
+				if (ti_ >= 0)
 				{
 					int ti = ti_ * 2;
 					mesh->texcoords.emplace_back(attrib.texcoords[ti], attrib.texcoords[ti + 1]);
@@ -13,6 +13,7 @@ int main(int argc, char *argv[])
 	app = Application::GetInstance();
 	app->CreateApplication("course3", 800, 600);
 	SoftRender::Initialize(800, 600);
+	SoftRender::SetThreadCount((int)std::thread::hardware_concurrency());
 	Start();
 	app->SetRunLoop(Update);
 	app->RunLoop();
@@ -41,7 +42,7 @@ struct Vertex
 
 };
 
-struct V2F
+struct V2F : ClipPositionVarying<V2F>
 {
 	Vector4 position;
 	Vector3 worldPos;
@@ -59,10 +60,10 @@ struct GBufferPass : Shader<Vertex, V2F>
 	V2F vert(const Vertex& input) override
 	{
 		V2F output;
-		output.position = _MATRIX_MVP.MultiplyPoint(input.position);
-		output.worldPos = _Object2World.MultiplyPoint3x4(input.position);
-		Vector3 normal = _Object2World.MultiplyVector(input.normal).Normalize();
-		Vector3 tangent = _Object2World.MultiplyVector(input.tangent.xyz).Normalize();
+		output.position = _Object->_MATRIX_MVP.MultiplyPoint(input.position);
+		output.worldPos = _Object->_Object2World.MultiplyPoint3x4(input.position);
+		Vector3 normal = _Object->_Object2World.MultiplyVector(input.normal).Normalize();
+		Vector3 tangent = _Object->_Object2World.MultiplyVector(input.tangent.xyz).Normalize();
 		Vector3 bitangent = normal.Cross(tangent) * input.tangent.w;
 		output.tSpace0 = Vector3(tangent.x, bitangent.x, normal.x);
 		output.tSpace1 = Vector3(tangent.y, bitangent.y, normal.y);
@@ -113,6 +114,13 @@ struct LightShadeV2F
 	Vector3 ray;
 };
 
+// per-instance light of the instanced shade pass
+struct PointLightInstance
+{
+	Vector3 position;
+	Color color;
+};
+
 struct LightShadePass : Shader<LightVertex, LightShadeV2F>
 {
 	Texture2DPtr diffuseGBuffer;
@@ -123,8 +131,8 @@ struct LightShadePass : Shader<LightVertex, LightShadeV2F>
 	LightShadeV2F vert(const LightVertex& input) override
 	{
 		LightShadeV2F output;
-		output.position = _MATRIX_MVP.MultiplyPoint(input.position);
-		output.ray = -_MATRIX_MV.MultiplyPoint(input.position).xyz;
+		output.position = _Object->_MATRIX_MVP.MultiplyPoint(input.position);
+		output.ray = -_Object->_MATRIX_MV.MultiplyPoint(input.position).xyz;
 		return output;
 	}
 
@@ -141,13 +149,21 @@ struct LightShadePass : Shader<LightVertex, LightShadeV2F>
 		lightInput.shininess = 10.f;
 		Vector3 worldNormal = UnpackNormal(Tex2D(*normalGBuffer, screenCoord));
 		float depth = Tex2D(*_CameraDepthTexture, screenCoord).a;
-		Vector3 viewPos = input.ray * (depth * _ZBufferParams.x / input.ray.z);
-		Vector3 worldPos = _CameraToWorld.MultiplyPoint(viewPos).xyz;
-		Vector3 worldView = (_WorldSpaceCameraPos - worldPos).Normalize();
+		Vector3 viewPos = input.ray * (depth * _Camera->_ZBufferParams.x / input.ray.z);
+		Vector3 worldPos = _Camera->_CameraToWorld.MultiplyPoint(viewPos).xyz;
+		Vector3 worldView = (_Camera->_WorldSpaceCameraPos - worldPos).Normalize();
 
+		Vector4 worldSpaceLightPos = _Light->_WorldSpaceLightPos;
+		Color instanceLightColor = _Light->_LightColor;
+		if (instanceData != nullptr)
+		{
+			auto& lightInstance = GetInstanceData<PointLightInstance>();
+			worldSpaceLightPos = Vector4(lightInstance.position, 1.f);
+			instanceLightColor = lightInstance.color;
+		}
 		Vector3 lightDir;
 		Color lightColor;
-		InitLightArgs(worldPos, lightDir, lightColor);
+		InitLightArgs(worldPos, worldSpaceLightPos, instanceLightColor, lightDir, lightColor);
 
 		Color fragColor = Color::clear;
 		fragColor.rgb = ShaderF::LightingBlinnPhong(lightInput, worldNormal, lightDir, lightColor.rgb, worldView);
@@ -155,6 +171,30 @@ struct LightShadePass : Shader<LightVertex, LightShadeV2F>
 	}
 };
 
+// NDC rect around a light volume on screen
+struct ScreenRect
+{
+	float minX, minY, maxX, maxY;
+
+	bool Overlaps(const ScreenRect& other) const
+	{
+		return minX <= other.maxX && other.minX <= maxX && minY <= other.maxY && other.minY <= maxY;
+	}
+};
+
+// Stencil lights drawn with one instanced pre pass and one instanced shade pass. Their rects
+// don't overlap, so no light's stencil marks are shaded by another light of the batch.
+struct StencilLightBatch
+{
+	std::vector<InstanceData> instances;
+	std::vector<ScreenRect> rects;
+
+	bool Overlaps(const ScreenRect& rect) const
+	{
+		return std::any_of(rects.begin(), rects.end(), [&rect](const ScreenRect& other) { return other.Overlaps(rect); });
+	}
+};
+
 int n = 10;
 float planeH = -0.5f;
 float lightH = 0.8f;
@@ -166,12 +206,44 @@ std::shared_ptr<Shader<LightVertex, LightV2F>> lightPrePass;
 std::shared_ptr<LightShadePass> lightShadePass;
 LightPtr light;
 std::vector<std::pair<Color, float>> lightColorIntensity;
-MeshPtr pointLightVolume;
-MeshPtr plane;
-MeshPtr cube;
+std::vector<PointLightInstance> lightInstances;
+std::vector<InstanceData> insideLightInstances;
+std::vector<InstanceData> cubeInstances;
+VertexBufferPtr pointLightVolumeVertices;
+IndexBufferPtr pointLightVolumeIndices;
+RenderDataPtr pointLightVolumeData;
+VertexBufferPtr planeVertices;
+IndexBufferPtr planeIndices;
+VertexBufferPtr cubeVertices;
+IndexBufferPtr cubeIndices;
 BitmapPtr diffuseGBuffer;
 BitmapPtr specularGBuffer;
 BitmapPtr normalGBuffer;
+std::vector<StencilLightBatch> stencilLightBatches;
+
+// the projected corners of the view-aligned box around a sphere, the whole screen when the
+// box reaches behind the near plane
+ScreenRect CalculateScreenRect(const Vector3& center, float radius)
+{
+	ScreenRect rect = { -1.f, -1.f, 1.f, 1.f };
+	Vector3 viewCenter = camera->viewMatrix().MultiplyPoint3x4(center);
+	if (viewCenter.z - radius < camera->zNear()) return rect;
+
+	Matrix4x4 projection = camera->projectionMatrix();
+	rect = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int i = 0; i < 8; ++i)
+	{
+		Vector3 corner = viewCenter + Vector3((i & 1) ? radius : -radius, (i & 2) ? radius : -radius, (i & 4) ? radius : -radius);
+		Vector4 clip = projection.MultiplyPoint(corner);
+		float x = clip.x / clip.w;
+		float y = clip.y / clip.w;
+		rect.minX = Mathf::Min(rect.minX, x);
+		rect.minY = Mathf::Min(rect.minY, y);
+		rect.maxX = Mathf::Max(rect.maxX, x);
+		rect.maxY = Mathf::Max(rect.maxY, y);
+	}
+	return rect;
+}
 
 void Start()
 {
@@ -181,7 +253,12 @@ void Start()
 	camera->transform.rotation = Quaternion(Vector3(30.f, 45.f, 0.f));
 	SoftRender::camera = camera;
 
-	pointLightVolume = LoadMesh("resources/point_light_volume.obj");
+	MeshPtr pointLightVolume = LoadMesh("resources/point_light_volume.obj");
+	pointLightVolumeVertices = VertexBuffer::Create<LightVertex>(*pointLightVolume);
+	pointLightVolumeIndices = IndexBuffer::Create(pointLightVolume->indices);
+	pointLightVolumeData = std::make_shared<RenderData>();
+	pointLightVolumeData->SetVertexBuffer(pointLightVolumeVertices);
+	pointLightVolumeData->SetIndexBuffer(pointLightVolumeIndices);
 
 	light = std::make_shared<Light>();
 	light->type = Light::LightType_Point;
@@ -197,12 +274,15 @@ void Start()
 	normalGBuffer = SoftRender::GetRenderTarget()->CreateGBuffer(2, Bitmap::BitmapType_RGB24);
 
 	gbufferPass = std::make_shared<GBufferPass>();
+	gbufferPass->isPositionFromMVP = true;
 	gbufferPass->diffuseMap = Texture2D::LoadTexture("resources/bric.tga");
 	gbufferPass->diffuseMap->GenerateMipmaps();
 	gbufferPass->normalMap = Texture2D::LoadTexture("resources/bric_n.tga");
 	gbufferPass->normalMap->GenerateMipmaps();
 	lightPrePass = std::make_shared<Shader<LightVertex, LightV2F>>();
+	lightPrePass->isPositionFromMVP = true;
 	lightShadePass = std::make_shared<LightShadePass>();
+	lightShadePass->isPositionFromMVP = true;
 	lightShadePass->diffuseGBuffer = Texture2D::CreateWithBitmap(diffuseGBuffer);
 	lightShadePass->diffuseGBuffer->filterMode = Texture2D::FilterMode_Point;
 	lightShadePass->specularGBuffer = Texture2D::CreateWithBitmap(specularGBuffer);
@@ -213,8 +293,12 @@ void Start()
 	lightShadePass->_CameraDepthTexture = Texture2D::CreateWithBitmap(linearDepthBuffer);
 	lightShadePass->_CameraDepthTexture->filterMode = Texture2D::FilterMode_Point;
 
-	plane = CreatePlane();
-	cube = CreateCube();
+	MeshPtr plane = CreatePlane();
+	planeVertices = VertexBuffer::Create<Vertex>(*plane);
+	planeIndices = IndexBuffer::Create(plane->indices);
+	MeshPtr cube = CreateCube();
+	cubeVertices = VertexBuffer::Create<Vertex>(*cube);
+	cubeIndices = IndexBuffer::Create(cube->indices);
 }
 
 void Update()
@@ -237,82 +321,113 @@ void Update()
 	SoftRender::renderState.zTest = RenderState::ZTestType_LEqual;
 	SoftRender::renderState.zWrite = true;
 	SoftRender::SetShader(gbufferPass);
-	SoftRender::renderData.AssetVerticesIndicesBuffer<Vertex>(*plane);
+	SoftRender::renderData.SetVertexBuffer(planeVertices);
+	SoftRender::renderData.SetIndexBuffer(planeIndices);
 	objectTrans.position = Vector3(0.f, planeH, 0.f);
 	objectTrans.rotation = Quaternion(Vector3(90.f, 0.f, 0.f));
 	objectTrans.scale = Vector3::one * 100.f;
 	SoftRender::modelMatrix = objectTrans.localToWorldMatrix();
 	SoftRender::Submit();
-	SoftRender::renderData.AssetVerticesIndicesBuffer<Vertex>(*cube);
+	SoftRender::renderData.SetVertexBuffer(cubeVertices);
+	SoftRender::renderData.SetIndexBuffer(cubeIndices);
+	cubeInstances.resize(n * n);
 	for (int i = 0; i < n * n; ++i)
 	{
 		objectTrans.position = Vector3((i / n) * 2.f, 0.f, (i % n) * 2.f);
 		objectTrans.rotation = Quaternion::identity;
 		objectTrans.scale = Vector3::one;
-		SoftRender::modelMatrix = objectTrans.localToWorldMatrix();
-		SoftRender::Submit();
+		cubeInstances[i].modelMatrix = objectTrans.localToWorldMatrix();
 	}
+	SoftRender::SubmitInstanced(n * n, cubeInstances.data());
 
 	SoftRender::GetRenderTarget()->SetGBuffer(0, nullptr);
 	SoftRender::GetRenderTarget()->SetGBuffer(1, nullptr);
 	SoftRender::GetRenderTarget()->SetGBuffer(2, nullptr);
 
 	// Light Pass
-	SoftRender::renderData.AssetVerticesIndicesBuffer<LightVertex>(*pointLightVolume);
-
+	SoftRender::renderData.SetVertexBuffer(pointLightVolumeVertices);
+	SoftRender::renderData.SetIndexBuffer(pointLightVolumeIndices);
+
+	// all point lights share range and attenuation, only position and color are per instance
+	light->range = 5.f; //20.f
+	lightInstances.resize(n * n);
+	insideLightInstances.clear();
+	stencilLightBatches.clear();
+	const Bounds& volumeBounds = pointLightVolumeData->GetBounds();
 	for (int i = 0; i < n * n; ++i)
 	{
-		light->color = lightColorIntensity[i].first;
-		light->intensity = lightColorIntensity[i].second;
-		light->range = 5.f; //20.f
-		light->transform.position = Vector3((i / n) * 2.f, lightH, (i % n) * 2.f);
+		InstanceData instance;
+		lightInstances[i].position = Vector3((i / n) * 2.f, lightH, (i % n) * 2.f);
+		lightInstances[i].color = lightColorIntensity[i].first * lightColorIntensity[i].second;
+		light->transform.position = lightInstances[i].position;
 		light->transform.scale = Vector3::one * light->range;
-		SoftRender::modelMatrix = light->transform.localToWorldMatrix();
-		Vector3 lightInCameraSpace = (camera->viewMatrix() * SoftRender::modelMatrix).MultiplyPoint3x4(light->transform.position);
+		instance.modelMatrix = light->transform.localToWorldMatrix();
+		instance.userData = (rawptr_t)&lightInstances[i];
+		Vector3 lightInCameraSpace = (camera->viewMatrix() * instance.modelMatrix).MultiplyPoint3x4(light->transform.position);
 		if (lightInCameraSpace.z - light->range < camera->zNear())
 		{
-			SoftRender::renderState.stencilOn = false;
-			SoftRender::renderState.alphaBlend = true;
-			SoftRender::renderState.blender.SetColorBlendMode(Blender::BlendMode_One, Blender::BlendMode_One);
-			SoftRender::renderState.blender.SetAlphaBlendMode(Blender::BlendMode_Zero, Blender::BlendMode_One);
-			SoftRender::renderState.zWrite = false;
-			SoftRender::renderState.cull = RenderState::CullType_Front;
-			SoftRender::renderState.zTest = RenderState::ZTestType_GEqual;
-			SoftRender::SetShader(lightShadePass);
-			SoftRender::Submit();
-		}
-		else
-		{
-			SoftRender::ClearStencilBuffer(0x00);
-			SoftRender::renderState.stencilOn = true;
-			SoftRender::renderState.stencilComp = RenderState::StencilComparison_Always;
-			SoftRender::renderState.stencilOp = RenderState::StencilOperation_Replace;
-			SoftRender::renderState.stencilRefValue = 0xff;
-			SoftRender::renderState.alphaBlend = true;
-			SoftRender::renderState.blender.SetColorBlendMode(Blender::BlendMode_Zero, Blender::BlendMode_One);
-			SoftRender::renderState.blender.SetAlphaBlendMode(Blender::BlendMode_Zero, Blender::BlendMode_One);
-			SoftRender::renderState.zWrite = false;
-			SoftRender::renderState.cull = RenderState::CullType_Front;
-			SoftRender::renderState.zTest = RenderState::ZTestType_GEqual;
-			SoftRender::SetShader(lightPrePass);
-			SoftRender::Submit();
-
-			// Shade Pass
-			SoftRender::renderState.stencilOn = true;
-			SoftRender::renderState.stencilComp = RenderState::StencilComparison_Equal;
-			SoftRender::renderState.stencilOp = RenderState::StencilOperation_Zero;
-			SoftRender::renderState.stencilRefValue = 0xff;
-			SoftRender::renderState.alphaBlend = true;
-			SoftRender::renderState.blender.SetColorBlendMode(Blender::BlendMode_One, Blender::BlendMode_One);
-			SoftRender::renderState.blender.SetAlphaBlendMode(Blender::BlendMode_Zero, Blender::BlendMode_One);
-			SoftRender::renderState.zWrite = false;
-			SoftRender::renderState.cull = RenderState::CullType_Back;
-			SoftRender::renderState.zTest = RenderState::ZTestType_LEqual;
-			SoftRender::SetShader(lightShadePass);
-			SoftRender::Submit();
+			insideLightInstances.push_back(instance);
+			continue;
 		}
+
+		// the first batch the light doesn't overlap on screen
+		ScreenRect rect = CalculateScreenRect(light->transform.position + volumeBounds.center * light->range, volumeBounds.radius * light->range);
+		auto batch = std::find_if(stencilLightBatches.begin(), stencilLightBatches.end(),
+			[&rect](const StencilLightBatch& other) { return !other.Overlaps(rect); });
+		if (batch == stencilLightBatches.end()) batch = stencilLightBatches.emplace(stencilLightBatches.end());
+		batch->instances.push_back(instance);
+		batch->rects.push_back(rect);
+	}
+
+	for (int i = 0; i < (int)stencilLightBatches.size(); ++i)
+	{
+		// every batch marks with its own value, so the marks earlier batches left need no clear
+		uint8_t stencilRef = (uint8_t)(i % 255 + 1);
+		if (stencilRef == 1) SoftRender::ClearStencilBuffer(0x00);
+		StencilLightBatch& batch = stencilLightBatches[i];
+
+		SoftRender::renderState.stencilOn = true;
+		SoftRender::renderState.stencilComp = RenderState::StencilComparison_Always;
+		SoftRender::renderState.stencilOp = RenderState::StencilOperation_Replace;
+		SoftRender::renderState.stencilRefValue = stencilRef;
+		SoftRender::renderState.alphaBlend = true;
+		SoftRender::renderState.blender.SetColorBlendMode(Blender::BlendMode_Zero, Blender::BlendMode_One);
+		SoftRender::renderState.blender.SetAlphaBlendMode(Blender::BlendMode_Zero, Blender::BlendMode_One);
+		SoftRender::renderState.zWrite = false;
+		SoftRender::renderState.cull = RenderState::CullType_Front;
+		SoftRender::renderState.zTest = RenderState::ZTestType_GEqual;
+		SoftRender::SetShader(lightPrePass);
+		SoftRender::SubmitInstanced((int)batch.instances.size(), batch.instances.data());
+
+		// Shade Pass
+		SoftRender::renderState.stencilOn = true;
+		SoftRender::renderState.stencilComp = RenderState::StencilComparison_Equal;
+		SoftRender::renderState.stencilOp = RenderState::StencilOperation_Zero;
+		SoftRender::renderState.stencilRefValue = stencilRef;
+		SoftRender::renderState.alphaBlend = true;
+		SoftRender::renderState.blender.SetColorBlendMode(Blender::BlendMode_One, Blender::BlendMode_One);
+		SoftRender::renderState.blender.SetAlphaBlendMode(Blender::BlendMode_Zero, Blender::BlendMode_One);
+		SoftRender::renderState.zWrite = false;
+		SoftRender::renderState.cull = RenderState::CullType_Back;
+		SoftRender::renderState.zTest = RenderState::ZTestType_LEqual;
+		SoftRender::SetShader(lightShadePass);
+		SoftRender::SubmitInstanced((int)batch.instances.size(), batch.instances.data());
 	}
-	
+
+	// lights the camera may be inside shade the back faces of their volume without a stencil pass
+	if (!insideLightInstances.empty())
+	{
+		SoftRender::renderState.stencilOn = false;
+		SoftRender::renderState.alphaBlend = true;
+		SoftRender::renderState.blender.SetColorBlendMode(Blender::BlendMode_One, Blender::BlendMode_One);
+		SoftRender::renderState.blender.SetAlphaBlendMode(Blender::BlendMode_Zero, Blender::BlendMode_One);
+		SoftRender::renderState.zWrite = false;
+		SoftRender::renderState.cull = RenderState::CullType_Front;
+		SoftRender::renderState.zTest = RenderState::ZTestType_GEqual;
+		SoftRender::SetShader(lightShadePass);
+		SoftRender::SubmitInstanced((int)insideLightInstances.size(), insideLightInstances.data());
+	}
+
 	SoftRender::Present();
 
 	if (app->GetInput()->GetKey(GLFW_KEY_ENTER))
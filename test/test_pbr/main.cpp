@@ -12,6 +12,7 @@ int main(int argc, char *argv[])
 	app = Application::GetInstance();
 	app->CreateApplication("pbr", 800, 800);
 	SoftRender::Initialize(800, 800);
+	SoftRender::SetThreadCount((int)std::thread::hardware_concurrency());
 	app->SetRunLoop(MainLoop);
 	app->RunLoop();
 	return 0;
@@ -38,7 +39,7 @@ struct Vertex
 	}
 };
 
-struct V2F
+struct V2F : ClipPositionVarying<V2F>
 {
 	Vector4 position;
 	Vector2 texcoord;
@@ -59,16 +60,16 @@ struct MainShader : Shader<Vertex, V2F>
 	V2F vert(const Vertex& input) override
 	{
 		V2F output;
-		output.position = _MATRIX_MVP.MultiplyPoint(input.position);
+		output.position = _Object->_MATRIX_MVP.MultiplyPoint(input.position);
 		output.texcoord = input.texcoord;
-		Vector3 normal = _Object2World.MultiplyVector(input.normal).Normalize();
-		Vector3 tangent = _Object2World.MultiplyVector(input.tangent.xyz).Normalize();
+		Vector3 normal = _Object->_Object2World.MultiplyVector(input.normal).Normalize();
+		Vector3 tangent = _Object->_Object2World.MultiplyVector(input.tangent.xyz).Normalize();
 		Vector3 bitangent = normal.Cross(tangent) * input.tangent.w;
 		output.tspace0 = Vector3(tangent.x, bitangent.x, normal.x);
 		output.tspace1 = Vector3(tangent.y, bitangent.y, normal.y);
 		output.tspace2 = Vector3(tangent.z, bitangent.z, normal.z);
 
-		output.worldPos = _Object2World.MultiplyPoint3x4(input.position);
+		output.worldPos = _Object->_Object2World.MultiplyPoint3x4(input.position);
 		return output;
 	}
 
@@ -94,7 +95,7 @@ struct MainShader : Shader<Vertex, V2F>
 		pbsLight.color = lightColor.rgb;
 		pbsLight.dir = lightDir;
 
-		Vector3 viewDir = (_WorldSpaceCameraPos - input.worldPos).Normalize();
+		Vector3 viewDir = (_Camera->_WorldSpaceCameraPos - input.worldPos).Normalize();
 
 		Color fragColor = Color::white * 0.1f;
 		fragColor.rgb += PBSF::BRDF1(pbsInput, pbsInput.normal, viewDir, pbsLight);
@@ -129,6 +130,7 @@ void MainLoop()
 		SoftRender::light = light;
 
 		shader = std::make_shared<MainShader>();
+		shader->isPositionFromMVP = true;
 		shader->albedoMap = Texture2D::LoadTexture("resources/pbr/knife_albedo.png");
 		shader->normalMap = Texture2D::LoadTexture("resources/pbr/knife_normal.png");
 		shader->paramMap = Texture2D::LoadTexture("resources/pbr/knife_param.png");
@@ -38,7 +38,7 @@ struct Vertex
 	}
 };
 
-struct V2F
+struct V2F : ClipPositionVarying<V2F>
 {
 	Vector4 position;
 	Vector3 worldPos;
@@ -56,11 +56,11 @@ struct ForwardBaseShader : Shader<Vertex, V2F>
 	V2F vert(const Vertex& input) override
 	{
 		V2F output;
-		output.position = _MATRIX_MVP.MultiplyPoint(input.position);
-		output.worldPos = _Object2World.MultiplyPoint3x4(input.position);
+		output.position = _Object->_MATRIX_MVP.MultiplyPoint(input.position);
+		output.worldPos = _Object->_Object2World.MultiplyPoint3x4(input.position);
 		output.texcoord = input.texcoord * 2.f;
-		Vector3 normal = _Object2World.MultiplyVector(input.normal).Normalize();
-		Vector3 tangent = _Object2World.MultiplyVector(input.tangent.xyz).Normalize();
+		Vector3 normal = _Object->_Object2World.MultiplyVector(input.normal).Normalize();
+		Vector3 tangent = _Object->_Object2World.MultiplyVector(input.tangent.xyz).Normalize();
 		Vector3 bitangent = normal.Cross(tangent) * input.tangent.w;
 		output.tspace0 = Vector3(tangent.x, bitangent.x, normal.x);
 		output.tspace1 = Vector3(tangent.y, bitangent.y, normal.y);
@@ -86,7 +86,7 @@ struct ForwardBaseShader : Shader<Vertex, V2F>
 		Color lightColor;
 		InitLightArgs(input.worldPos, lightDir, lightColor);
 
-		Vector3 viewDir = (_WorldSpaceCameraPos - input.worldPos).Normalize();
+		Vector3 viewDir = (_Camera->_WorldSpaceCameraPos - input.worldPos).Normalize();
 		Color fragColor;
 		fragColor.rgb = ShaderF::LightingPhong(lightInput, worldNormal, lightDir, lightColor.rgb, viewDir);
 		SV_Target0 = fragColor;
@@ -101,11 +101,11 @@ struct ForwardAdditionShader : Shader<Vertex, V2F>
 	V2F vert(const Vertex& input) override
 	{
 		V2F output;
-		output.position = _MATRIX_MVP.MultiplyPoint(input.position);
-		output.worldPos = _Object2World.MultiplyPoint3x4(input.position);
+		output.position = _Object->_MATRIX_MVP.MultiplyPoint(input.position);
+		output.worldPos = _Object->_Object2World.MultiplyPoint3x4(input.position);
 		output.texcoord = input.texcoord * 2.f;
-		Vector3 normal = _Object2World.MultiplyVector(input.normal).Normalize();
-		Vector3 tangent = _Object2World.MultiplyVector(input.tangent.xyz).Normalize();
+		Vector3 normal = _Object->_Object2World.MultiplyVector(input.normal).Normalize();
+		Vector3 tangent = _Object->_Object2World.MultiplyVector(input.tangent.xyz).Normalize();
 		Vector3 bitangent = normal.Cross(tangent) * input.tangent.w;
 		output.tspace0 = Vector3(tangent.x, bitangent.x, normal.x);
 		output.tspace1 = Vector3(tangent.y, bitangent.y, normal.y);
@@ -133,7 +133,7 @@ struct ForwardAdditionShader : Shader<Vertex, V2F>
 		Color lightColor;
 		InitLightArgs(input.worldPos, lightDir, lightColor);
 
-		Vector3 viewDir = (_WorldSpaceCameraPos - input.worldPos).Normalize();
+		Vector3 viewDir = (_Camera->_WorldSpaceCameraPos - input.worldPos).Normalize();
 		fragColor.rgb = ShaderF::LightingPhong(lightInput, worldNormal, lightDir, lightColor.rgb, viewDir);
 		SV_Target0 = fragColor;
 	}
@@ -149,7 +149,8 @@ void MainLoop()
 	static std::shared_ptr<ForwardAdditionShader> forwardAdditionShader;
 	static LightPtr lightRed;
 	static LightPtr lightBlue;
-	static MeshPtr mesh;
+	static VertexBufferPtr vertexBuffer;
+	static IndexBufferPtr indexBuffer;
 
 	if (!isInitilized)
 	{
@@ -189,23 +190,28 @@ void MainLoop()
 		lightBlue->Initilize();
 
 		forwardBaseShader = std::make_shared<ForwardBaseShader>();
+		forwardBaseShader->isPositionFromMVP = true;
 		forwardBaseShader->diffuseMap = Texture2D::LoadTexture("resources/bric.tga");
 		forwardBaseShader->diffuseMap->GenerateMipmaps();
 		forwardBaseShader->normalMap = Texture2D::LoadTexture("resources/bric_n.tga");
 		forwardBaseShader->normalMap->GenerateMipmaps();
 		forwardAdditionShader = std::make_shared<ForwardAdditionShader>();
+		forwardAdditionShader->isPositionFromMVP = true;
 		forwardAdditionShader->diffuseMap = forwardBaseShader->diffuseMap;
 		forwardAdditionShader->normalMap = forwardBaseShader->normalMap;
 
-		mesh = CreatePlane();
+		MeshPtr mesh = CreatePlane();
 		mesh->CalculateTangents();
+		vertexBuffer = VertexBuffer::Create<Vertex>(*mesh);
+		indexBuffer = IndexBuffer::Create(mesh->indices);
 	}
 
 	SoftRender::Clear(true, true, Color(1.f, 0.19f, 0.3f, 0.47f));
 
 	objectCtrl.MouseRotate(objectTrans, false);
 	SoftRender::modelMatrix = objectTrans.localToWorldMatrix();
-	SoftRender::renderData.AssetVerticesIndicesBuffer<Vertex>(*mesh);
+	SoftRender::renderData.SetVertexBuffer(vertexBuffer);
+	SoftRender::renderData.SetIndexBuffer(indexBuffer);
 
 	SoftRender::light = lightRed;
 	SoftRender::renderState.alphaBlend = false;